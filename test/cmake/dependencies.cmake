@@ -31,6 +31,7 @@ FetchContent_Declare(
 FetchContent_MakeAvailable(nlohmann_json)
 
 target_include_directories(${PROJECT_NAME} PRIVATE ${nlohmann_json_SOURCE_DIR}/include)
+target_include_directories(odin_bench PRIVATE ${nlohmann_json_SOURCE_DIR}/include)
 
 # =============================================================================
 # miniaudio
@@ -63,3 +64,23 @@ FetchContent_Declare(
 FetchContent_MakeAvailable(spdlog)
 
 target_include_directories(${PROJECT_NAME} PRIVATE ${spdlog_SOURCE_DIR}/include)
+
+# =============================================================================
+# Google Benchmark
+# =============================================================================
+
+message(STATUS "Installing Google Benchmark")
+
+set(BENCHMARK_ENABLE_TESTING OFF CACHE BOOL "" FORCE)
+set(BENCHMARK_ENABLE_GTEST_TESTS OFF CACHE BOOL "" FORCE)
+set(BENCHMARK_ENABLE_INSTALL OFF CACHE BOOL "" FORCE)
+
+FetchContent_Declare(
+    benchmark
+    GIT_REPOSITORY https://github.com/google/benchmark.git
+    GIT_TAG        v1.9.4
+    EXCLUDE_FROM_ALL
+)
+FetchContent_MakeAvailable(benchmark)
+
+target_link_libraries(odin_bench PRIVATE benchmark::benchmark)
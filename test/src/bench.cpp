@@ -0,0 +1,701 @@
+/*
+ * 4Players ODIN Voice Microbenchmarks
+ *
+ * Usage: odin_bench --benchmark_format=json --benchmark_out=results.json
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <numbers>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+
+#include <odin.h>
+#include <odin_crypto.h>
+
+#include "formats.hpp"
+#include "mixer.hpp"
+#include "tokens.hpp"
+
+#define ODIN_MAX_DATAGRAM_SIZE 2048
+#define ODIN_BENCH_PASSWORD "odin_bench"
+
+template <class T> using OpaquePtr = std::unique_ptr<T, void (*)(T *)>;
+
+/**
+ * Bit flags selecting the built-in effects inserted into an encoder pipeline.
+ */
+enum Effects : int64_t {
+  EFFECTS_NONE = 0,
+  EFFECTS_VAD = 1 << 0,
+  EFFECTS_APM = 1 << 1,
+};
+
+/**
+ * Sample formats the application exchanges with encoders and decoders.
+ */
+enum SampleFormat : int64_t {
+  SAMPLE_FORMAT_F32 = 0,
+  SAMPLE_FORMAT_I16 = 1,
+  SAMPLE_FORMAT_PLANAR = 2,
+};
+
+// ─── FIXTURES ────────────────────────────────────────────────────────────────
+
+/**
+ * Returns one second of interleaved audio at the given format. The signal is
+ * a tone with a bit of deterministic noise on top, so both the codec and the
+ * voice activity detection have something realistic to work with.
+ */
+static std::vector<float> make_signal(uint32_t sample_rate,
+                                      uint32_t channels) {
+  std::vector<float> samples(sample_rate * channels);
+  const auto step = 2.0 * std::numbers::pi * 220.0 / sample_rate;
+  uint32_t noise = 0x12345678;
+  for (uint32_t frame = 0; frame < sample_rate; ++frame) {
+    noise = noise * 1664525u + 1013904223u;
+    auto value = 0.25f * static_cast<float>(std::sin(step * frame)) +
+                 0.01f * (static_cast<float>(noise >> 8) / (1 << 24) - 0.5f);
+    for (uint32_t channel = 0; channel < channels; ++channel) {
+      samples[frame * channels + channel] = value;
+    }
+  }
+  return samples;
+}
+
+/**
+ * Creates an encoder for the given format and inserts the requested effects
+ * in the same order the test client uses.
+ */
+static OpaquePtr<OdinEncoder> make_encoder(uint32_t sample_rate,
+                                           uint32_t channels, int64_t effects) {
+  OdinEncoder *encoder = nullptr;
+  if (odin_encoder_create(0, sample_rate, channels == 2, &encoder) !=
+      ODIN_ERROR_SUCCESS) {
+    return {nullptr, &odin_encoder_free};
+  }
+  const OdinPipeline *pipeline = odin_encoder_get_pipeline(encoder);
+  uint32_t effect_id;
+  if (effects & EFFECTS_APM) {
+    OdinApmConfig config = {
+        .echo_canceller = true,
+        .high_pass_filter = false,
+        .transient_suppressor = false,
+        .noise_suppression_level = ODIN_NOISE_SUPPRESSION_LEVEL_MODERATE,
+        .gain_controller_version = ODIN_GAIN_CONTROLLER_VERSION_V2};
+    odin_pipeline_insert_apm_effect(pipeline,
+                                    odin_pipeline_get_effect_count(pipeline),
+                                    sample_rate, channels == 2, &effect_id);
+    odin_pipeline_set_apm_config(pipeline, effect_id, &config);
+  }
+  if (effects & EFFECTS_VAD) {
+    odin_pipeline_insert_vad_effect(
+        pipeline, odin_pipeline_get_effect_count(pipeline), &effect_id);
+  }
+  return {encoder, &odin_encoder_free};
+}
+
+/**
+ * Pops all datagrams currently available from the given encoder and returns
+ * their count. Each datagram is passed to `sink` if one is given.
+ */
+template <typename F>
+static int64_t drain_encoder(OdinEncoder *encoder, F &&sink) {
+  int64_t count = 0;
+  for (;;) {
+    uint8_t datagram[ODIN_MAX_DATAGRAM_SIZE];
+    uint32_t datagram_length = sizeof(datagram);
+    if (odin_encoder_pop(encoder, datagram, &datagram_length) !=
+        ODIN_ERROR_SUCCESS) {
+      return count;
+    }
+    sink(datagram, datagram_length);
+    ++count;
+  }
+}
+
+/**
+ * Encodes one second of the benchmark signal at 48 kHz mono and returns the
+ * resulting datagrams, which serve as input for the decoder benchmarks.
+ */
+static const std::vector<std::vector<uint8_t>> &get_datagrams() {
+  static const auto datagrams = [] {
+    std::vector<std::vector<uint8_t>> result;
+    auto encoder = make_encoder(48000, 1, EFFECTS_NONE);
+    auto signal = make_signal(48000, 1);
+    for (std::size_t offset = 0; offset < signal.size(); offset += 960) {
+      odin_encoder_push(encoder.get(), signal.data() + offset, 960);
+      drain_encoder(encoder.get(), [&](const uint8_t *bytes, uint32_t length) {
+        result.emplace_back(bytes, bytes + length);
+      });
+    }
+    return result;
+  }();
+  return datagrams;
+}
+
+/**
+ * Returns a cipher with a master password already applied. Key derivation
+ * runs PBKDF2 with a high iteration count, so it is done only once.
+ */
+static OdinCipher *get_cipher() {
+  static OdinCipher *cipher = [] {
+    OdinCipher *cipher = odin_crypto_create(ODIN_CRYPTO_VERSION);
+    if (!cipher) {
+      return cipher;
+    }
+    odin_crypto_set_password(
+        cipher, reinterpret_cast<const uint8_t *>(ODIN_BENCH_PASSWORD),
+        sizeof(ODIN_BENCH_PASSWORD) - 1);
+    return cipher;
+  }();
+  return cipher;
+}
+
+static void custom_effect_noop(float *samples, uint32_t samples_count,
+                               bool *is_silent, const void *user_data) {
+  benchmark::DoNotOptimize(samples);
+}
+
+// ─── ENCODER ─────────────────────────────────────────────────────────────────
+
+/**
+ * Pushes 20 ms blocks of audio into an encoder and pops the resulting
+ * datagrams. Arguments: sample rate, channel count, effect flags.
+ */
+static void BM_Encoder(benchmark::State &state) {
+  const auto sample_rate = static_cast<uint32_t>(state.range(0));
+  const auto channels = static_cast<uint32_t>(state.range(1));
+  auto encoder = make_encoder(sample_rate, channels, state.range(2));
+  if (!encoder) {
+    state.SkipWithError(odin_error_get_last_error());
+    return;
+  }
+
+  const auto signal = make_signal(sample_rate, channels);
+  const auto block = sample_rate / 50 * channels;
+  std::size_t offset = 0;
+  int64_t datagrams = 0;
+  for (auto _ : state) {
+    odin_encoder_push(encoder.get(), signal.data() + offset, block);
+    datagrams += drain_encoder(encoder.get(), [](const uint8_t *, uint32_t) {});
+    offset = (offset + block) % signal.size();
+  }
+
+  state.SetItemsProcessed(state.iterations() * (block / channels));
+  state.counters["datagrams"] =
+      benchmark::Counter(datagrams, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Encoder)
+    ->ArgNames({"rate", "channels", "effects"})
+    ->ArgsProduct({{16000, 44100, 48000},
+                   {1, 2},
+                   {EFFECTS_NONE, EFFECTS_VAD, EFFECTS_VAD | EFFECTS_APM}});
+
+/**
+ * Measures the overhead of custom effect callbacks in the encoder pipeline
+ * by inserting the given number of no-op effects. Arguments: effect count.
+ */
+static void BM_EncoderCustomEffects(benchmark::State &state) {
+  auto encoder = make_encoder(48000, 1, EFFECTS_NONE);
+  if (!encoder) {
+    state.SkipWithError(odin_error_get_last_error());
+    return;
+  }
+  const OdinPipeline *pipeline = odin_encoder_get_pipeline(encoder.get());
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    odin_pipeline_insert_custom_effect(pipeline, 0, custom_effect_noop,
+                                       nullptr, nullptr);
+  }
+
+  const auto signal = make_signal(48000, 1);
+  std::size_t offset = 0;
+  for (auto _ : state) {
+    odin_encoder_push(encoder.get(), signal.data() + offset, 960);
+    drain_encoder(encoder.get(), [](const uint8_t *, uint32_t) {});
+    offset = (offset + 960) % signal.size();
+  }
+
+  state.SetItemsProcessed(state.iterations() * 960);
+}
+BENCHMARK(BM_EncoderCustomEffects)
+    ->ArgName("effects")
+    ->Arg(0)
+    ->Arg(1)
+    ->Arg(4)
+    ->Arg(16);
+
+/**
+ * Pushes 20 ms blocks of 48 kHz audio into an encoder without effects, with
+ * the samples converted from the given format on the way. Arguments: sample
+ * format, channel count.
+ */
+static void BM_EncoderSampleFormat(benchmark::State &state) {
+  const auto format = state.range(0);
+  const auto channels = static_cast<uint32_t>(state.range(1));
+  auto encoder = make_encoder(48000, channels, EFFECTS_NONE);
+  if (!encoder) {
+    state.SkipWithError(odin_error_get_last_error());
+    return;
+  }
+
+  const auto signal = make_signal(48000, channels);
+  const uint32_t frames = 960;
+  std::vector<int16_t> pcm(signal.size());
+  mixer::to_i16(signal.data(), pcm.data(), signal.size());
+  std::vector<float> planar(signal.size());
+  float *planes[2] = {planar.data(), planar.data() + 48000};
+  mixer::deinterleave(signal.data(), planes, channels, 48000);
+
+  uint32_t frame = 0;
+  for (auto _ : state) {
+    switch (format) {
+    case SAMPLE_FORMAT_I16:
+      formats::encoder_push_i16(encoder.get(), pcm.data() + frame * channels,
+                                frames * channels);
+      break;
+    case SAMPLE_FORMAT_PLANAR: {
+      const float *offset_planes[2];
+      for (uint32_t channel = 0; channel < channels; ++channel) {
+        offset_planes[channel] = planes[channel] + frame;
+      }
+      formats::encoder_push_planar(encoder.get(), offset_planes, channels,
+                                   frames);
+      break;
+    }
+    default:
+      odin_encoder_push(encoder.get(), signal.data() + frame * channels,
+                        frames * channels);
+    }
+    drain_encoder(encoder.get(), [](const uint8_t *, uint32_t) {});
+    frame = (frame + frames) % 48000;
+  }
+
+  state.SetItemsProcessed(state.iterations() * frames);
+}
+BENCHMARK(BM_EncoderSampleFormat)
+    ->ArgNames({"format", "channels"})
+    ->ArgsProduct({{SAMPLE_FORMAT_F32, SAMPLE_FORMAT_I16, SAMPLE_FORMAT_PLANAR},
+                   {1, 2}});
+
+// ─── DECODER ─────────────────────────────────────────────────────────────────
+
+/**
+ * Pushes 48 kHz mono datagrams into a decoder and pops 20 ms blocks at the
+ * given output format, which includes resampling for rates other than 48 kHz.
+ * Arguments: sample rate, channel count.
+ */
+static void BM_Decoder(benchmark::State &state) {
+  const auto sample_rate = static_cast<uint32_t>(state.range(0));
+  const auto channels = static_cast<uint32_t>(state.range(1));
+  const auto &datagrams = get_datagrams();
+  if (datagrams.empty()) {
+    state.SkipWithError("encoder produced no datagrams");
+    return;
+  }
+
+  OdinDecoder *ptr = nullptr;
+  if (odin_decoder_create(sample_rate, channels == 2, &ptr) !=
+      ODIN_ERROR_SUCCESS) {
+    state.SkipWithError(odin_error_get_last_error());
+    return;
+  }
+  OpaquePtr<OdinDecoder> decoder(ptr, &odin_decoder_free);
+
+  std::vector<float> samples(sample_rate / 50 * channels);
+  std::size_t index = 0;
+  for (auto _ : state) {
+    const auto &datagram = datagrams[index];
+    odin_decoder_push(decoder.get(), datagram.data(), datagram.size());
+    bool is_silent;
+    odin_decoder_pop(decoder.get(), samples.data(), samples.size(),
+                     &is_silent);
+    benchmark::DoNotOptimize(samples.data());
+    index = (index + 1) % datagrams.size();
+  }
+
+  state.SetItemsProcessed(state.iterations() * (samples.size() / channels));
+}
+BENCHMARK(BM_Decoder)
+    ->ArgNames({"rate", "channels"})
+    ->ArgsProduct({{16000, 44100, 48000}, {1, 2}});
+
+/**
+ * Like `BM_Decoder` at 48 kHz, but pops the samples in the given format.
+ * Arguments: sample format, channel count.
+ */
+static void BM_DecoderSampleFormat(benchmark::State &state) {
+  const auto format = state.range(0);
+  const auto channels = static_cast<uint32_t>(state.range(1));
+  const auto &datagrams = get_datagrams();
+  if (datagrams.empty()) {
+    state.SkipWithError("encoder produced no datagrams");
+    return;
+  }
+
+  OdinDecoder *ptr = nullptr;
+  if (odin_decoder_create(48000, channels == 2, &ptr) != ODIN_ERROR_SUCCESS) {
+    state.SkipWithError(odin_error_get_last_error());
+    return;
+  }
+  OpaquePtr<OdinDecoder> decoder(ptr, &odin_decoder_free);
+
+  const uint32_t frames = 960;
+  std::vector<float> samples(frames * channels);
+  std::vector<int16_t> pcm(frames * channels);
+  float *planes[2] = {samples.data(), samples.data() + frames};
+  std::size_t index = 0;
+  for (auto _ : state) {
+    const auto &datagram = datagrams[index];
+    odin_decoder_push(decoder.get(), datagram.data(), datagram.size());
+    bool is_silent;
+    switch (format) {
+    case SAMPLE_FORMAT_I16:
+      formats::decoder_pop_i16(decoder.get(), pcm.data(), pcm.size(),
+                               &is_silent);
+      benchmark::DoNotOptimize(pcm.data());
+      break;
+    case SAMPLE_FORMAT_PLANAR:
+      formats::decoder_pop_planar(decoder.get(), planes, channels, frames,
+                                  &is_silent);
+      benchmark::DoNotOptimize(samples.data());
+      break;
+    default:
+      odin_decoder_pop(decoder.get(), samples.data(), samples.size(),
+                       &is_silent);
+      benchmark::DoNotOptimize(samples.data());
+    }
+    index = (index + 1) % datagrams.size();
+  }
+
+  state.SetItemsProcessed(state.iterations() * frames);
+}
+BENCHMARK(BM_DecoderSampleFormat)
+    ->ArgNames({"format", "channels"})
+    ->ArgsProduct({{SAMPLE_FORMAT_F32, SAMPLE_FORMAT_I16, SAMPLE_FORMAT_PLANAR},
+                   {1, 2}});
+
+// ─── CRYPTO ──────────────────────────────────────────────────────────────────
+
+/**
+ * Encrypts a datagram of the given size with AES-256-GCM through the cipher
+ * callbacks. Arguments: payload size in bytes.
+ */
+static void BM_CipherEncryptDatagram(benchmark::State &state) {
+  OdinCipher *cipher = get_cipher();
+  if (!cipher) {
+    state.SkipWithError("odin_crypto_create failed");
+    return;
+  }
+  std::vector<uint8_t> plaintext(state.range(0), 0x5a);
+  std::vector<uint8_t> ciphertext(plaintext.size() +
+                                  cipher->additional_capacity_datagram);
+  for (auto _ : state) {
+    auto length = cipher->encrypt_datagram(cipher, plaintext.data(),
+                                           plaintext.size(), ciphertext.data(),
+                                           ciphertext.size());
+    if (length < 0) {
+      state.SkipWithError("encrypt_datagram failed");
+      break;
+    }
+    benchmark::DoNotOptimize(length);
+  }
+
+  state.SetBytesProcessed(state.iterations() * plaintext.size());
+}
+BENCHMARK(BM_CipherEncryptDatagram)
+    ->ArgName("bytes")
+    ->Arg(64)
+    ->Arg(160)
+    ->Arg(512)
+    ->Arg(1200);
+
+/**
+ * Decrypts a datagram of the given size which was previously encrypted by the
+ * same cipher. Arguments: payload size in bytes.
+ */
+static void BM_CipherDecryptDatagram(benchmark::State &state) {
+  OdinCipher *cipher = get_cipher();
+  if (!cipher) {
+    state.SkipWithError("odin_crypto_create failed");
+    return;
+  }
+  std::vector<uint8_t> plaintext(state.range(0), 0x5a);
+  std::vector<uint8_t> ciphertext(plaintext.size() +
+                                  cipher->additional_capacity_datagram);
+  auto ciphertext_length =
+      cipher->encrypt_datagram(cipher, plaintext.data(), plaintext.size(),
+                               ciphertext.data(), ciphertext.size());
+  if (ciphertext_length < 0) {
+    state.SkipWithError("encrypt_datagram failed");
+    return;
+  }
+
+  for (auto _ : state) {
+    auto length = cipher->decrypt_datagram(cipher, 0, ciphertext.data(),
+                                           ciphertext_length, plaintext.data(),
+                                           plaintext.size());
+    if (length < 0) {
+      state.SkipWithError("decrypt_datagram failed");
+      break;
+    }
+    benchmark::DoNotOptimize(length);
+  }
+
+  state.SetBytesProcessed(state.iterations() * plaintext.size());
+}
+BENCHMARK(BM_CipherDecryptDatagram)
+    ->ArgName("bytes")
+    ->Arg(64)
+    ->Arg(160)
+    ->Arg(512)
+    ->Arg(1200);
+
+/**
+ * Holds a burst of distinct voice-sized datagrams in both plaintext and
+ * encrypted form, laid out like the receive buffers of a busy room.
+ */
+struct DatagramBurst {
+  static constexpr std::size_t payload_size = 160;
+
+  std::vector<std::vector<uint8_t>> plaintexts;
+  std::vector<std::vector<uint8_t>> ciphertexts;
+  std::vector<int32_t> ciphertext_lengths;
+
+  bool init(OdinCipher *cipher, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+      auto &plaintext = this->plaintexts.emplace_back(payload_size);
+      for (std::size_t j = 0; j < payload_size; ++j) {
+        plaintext[j] = static_cast<uint8_t>(i * 31 + j);
+      }
+      auto &ciphertext = this->ciphertexts.emplace_back(
+          payload_size + cipher->additional_capacity_datagram);
+      auto length =
+          cipher->encrypt_datagram(cipher, plaintext.data(), plaintext.size(),
+                                   ciphertext.data(), ciphertext.size());
+      if (length < 0) {
+        return false;
+      }
+      this->ciphertext_lengths.push_back(length);
+    }
+    return true;
+  }
+};
+
+/**
+ * Encrypts a burst of voice datagrams back to back, the way a client hosting
+ * many local speakers or a recording server relaying them sends one 20 ms
+ * tick. Compared to `BM_CipherEncryptDatagram`, this shows how much of the
+ * per-datagram cost survives once keys and code are warm, which is the
+ * baseline any batched cipher interface has to beat. Arguments: datagrams
+ * per burst.
+ */
+static void BM_CipherEncryptBurst(benchmark::State &state) {
+  OdinCipher *cipher = get_cipher();
+  if (!cipher) {
+    state.SkipWithError("odin_crypto_create failed");
+    return;
+  }
+  DatagramBurst burst;
+  if (!burst.init(cipher, state.range(0))) {
+    state.SkipWithError("encrypt_datagram failed");
+    return;
+  }
+
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < burst.plaintexts.size(); ++i) {
+      auto length = cipher->encrypt_datagram(
+          cipher, burst.plaintexts[i].data(), burst.plaintexts[i].size(),
+          burst.ciphertexts[i].data(), burst.ciphertexts[i].size());
+      benchmark::DoNotOptimize(length);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * burst.plaintexts.size());
+  state.SetBytesProcessed(state.iterations() * burst.plaintexts.size() *
+                          DatagramBurst::payload_size);
+}
+BENCHMARK(BM_CipherEncryptBurst)
+    ->ArgName("datagrams")
+    ->Arg(8)
+    ->Arg(32)
+    ->Arg(128);
+
+/**
+ * Decrypts a burst of voice datagrams back to back, like the network thread
+ * does when draining the socket of a busy room once per tick. Arguments:
+ * datagrams per burst.
+ */
+static void BM_CipherDecryptBurst(benchmark::State &state) {
+  OdinCipher *cipher = get_cipher();
+  if (!cipher) {
+    state.SkipWithError("odin_crypto_create failed");
+    return;
+  }
+  DatagramBurst burst;
+  if (!burst.init(cipher, state.range(0))) {
+    state.SkipWithError("encrypt_datagram failed");
+    return;
+  }
+
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < burst.ciphertexts.size(); ++i) {
+      auto length = cipher->decrypt_datagram(
+          cipher, 0, burst.ciphertexts[i].data(), burst.ciphertext_lengths[i],
+          burst.plaintexts[i].data(), burst.plaintexts[i].size());
+      if (length < 0) {
+        state.SkipWithError("decrypt_datagram failed");
+        return;
+      }
+      benchmark::DoNotOptimize(length);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * burst.ciphertexts.size());
+  state.SetBytesProcessed(state.iterations() * burst.ciphertexts.size() *
+                          DatagramBurst::payload_size);
+}
+BENCHMARK(BM_CipherDecryptBurst)
+    ->ArgName("datagrams")
+    ->Arg(8)
+    ->Arg(32)
+    ->Arg(128);
+
+// ─── TOKENS ──────────────────────────────────────────────────────────────────
+
+/**
+ * Signs a room token with the same claims the test client uses.
+ */
+static void BM_TokenSign(benchmark::State &state) {
+  OdinTokenGenerator *ptr = nullptr;
+  if (odin_token_generator_create(nullptr, &ptr) != ODIN_ERROR_SUCCESS) {
+    state.SkipWithError(odin_error_get_last_error());
+    return;
+  }
+  OpaquePtr<OdinTokenGenerator> token_generator(ptr,
+                                                &odin_token_generator_free);
+
+  auto nbf = time(nullptr);
+  auto claims = nlohmann::json{{"rid", "default"},
+                               {"uid", "My User ID"},
+                               {"nbf", nbf},
+                               {"exp", nbf + 300}}
+                    .dump();
+  char token[1024];
+  for (auto _ : state) {
+    uint32_t token_length = sizeof(token);
+    odin_token_generator_sign(token_generator.get(), claims.c_str(), token,
+                              &token_length);
+    benchmark::DoNotOptimize(token);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TokenSign);
+
+/**
+ * Like `BM_TokenSign`, but renders the claims from a template that holds the
+ * room ID pre-serialized, the way the test client does.
+ */
+static void BM_TokenSignTemplate(benchmark::State &state) {
+  OdinTokenGenerator *ptr = nullptr;
+  if (odin_token_generator_create(nullptr, &ptr) != ODIN_ERROR_SUCCESS) {
+    state.SkipWithError(odin_error_get_last_error());
+    return;
+  }
+  OpaquePtr<OdinTokenGenerator> token_generator(ptr,
+                                                &odin_token_generator_free);
+
+  auto nbf = time(nullptr);
+  tokens::ClaimsTemplate claims(nlohmann::json{{"rid", "default"}});
+  std::string body;
+  char token[1024];
+  for (auto _ : state) {
+    claims.render(body, "My User ID", nbf, nbf + 300);
+    uint32_t token_length = sizeof(token);
+    odin_token_generator_sign(token_generator.get(), body.c_str(), token,
+                              &token_length);
+    benchmark::DoNotOptimize(token);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TokenSignTemplate);
+
+/**
+ * Signs a batch of 1024 tokens for distinct users with one generator per
+ * thread. Arguments: thread count.
+ */
+static void BM_TokenSignBatch(benchmark::State &state) {
+  OdinTokenGenerator *ptr = nullptr;
+  if (odin_token_generator_create(nullptr, &ptr) != ODIN_ERROR_SUCCESS) {
+    state.SkipWithError(odin_error_get_last_error());
+    return;
+  }
+  OpaquePtr<OdinTokenGenerator> token_generator(ptr,
+                                                &odin_token_generator_free);
+  char access_key[128];
+  uint32_t access_key_length = sizeof(access_key) - 1;
+  odin_token_generator_get_access_key(token_generator.get(), access_key,
+                                      &access_key_length);
+  access_key[access_key_length] = '\0';
+  auto signer = tokens::BatchSigner::create(access_key, state.range(0));
+  if (!signer) {
+    state.SkipWithError(odin_error_get_last_error());
+    return;
+  }
+
+  std::vector<std::string> user_ids;
+  for (int i = 0; i < 1024; ++i) {
+    user_ids.push_back("User #" + std::to_string(i));
+  }
+  auto nbf = time(nullptr);
+  tokens::ClaimsTemplate claims(nlohmann::json{{"rid", "default"}});
+  std::vector<std::string> room_tokens;
+  for (auto _ : state) {
+    if (signer->sign(claims, user_ids, nbf, nbf + 300, room_tokens) !=
+        ODIN_ERROR_SUCCESS) {
+      state.SkipWithError(odin_error_get_last_error());
+      break;
+    }
+    benchmark::DoNotOptimize(room_tokens.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * user_ids.size());
+}
+BENCHMARK(BM_TokenSignBatch)
+    ->ArgName("threads")
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->UseRealTime();
+
+// ─── MAIN ────────────────────────────────────────────────────────────────────
+
+int main(int argc, char *argv[]) {
+  if (odin_initialize(ODIN_VERSION) != ODIN_ERROR_SUCCESS) {
+    std::cerr << "odin_initialize failed: " << odin_error_get_last_error()
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+  benchmark::AddCustomContext("odin_version", ODIN_VERSION);
+  benchmark::AddCustomContext("odin_crypto_version", ODIN_CRYPTO_VERSION);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+
+  odin_shutdown();
+  return EXIT_SUCCESS;
+}
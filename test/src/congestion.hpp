@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+
+namespace congestion {
+
+/**
+ * Codec parameters an ODIN encoder is created with. Opus complexity, DTX and
+ * frame duration are not exposed by `odin_encoder_create_ex` and therefore
+ * not adapted.
+ */
+struct Settings {
+  uint32_t bitrate_kbps = 32;
+  uint32_t packet_loss_perc = 0;
+
+  bool operator==(const Settings &) const = default;
+};
+
+/**
+ * Thresholds and step sizes for the controller. Round-trip times above
+ * `rtt_high_ms` or a smoothed loss above `loss_high_percent` count as
+ * congestion; only samples below `rtt_low_ms` and half the loss threshold
+ * count towards raising the bitrate again, so the controller does not
+ * oscillate around a single threshold.
+ *
+ * Applying new settings means recreating the encoder, which resets its state
+ * and is audible, so the applied bitrate only follows the target once they
+ * are `bitrate_hysteresis_kbps` apart or the target reached a bound, and
+ * never sooner than a number of samples after the previous change. Changes
+ * that lower the bitrate or add loss protection wait for
+ * `degrade_hold_samples`, all others for `recover_hold_samples`.
+ */
+struct Config {
+  uint32_t min_bitrate_kbps = 12;
+  uint32_t max_bitrate_kbps = 32;
+  float rtt_high_ms = 250.0f;
+  float rtt_low_ms = 150.0f;
+  double loss_high_percent = 5.0;
+  double decrease_factor = 0.75;
+  uint32_t increase_step_kbps = 4;
+  uint32_t increase_after = 5;
+  uint32_t max_packet_loss_perc = 30;
+  uint32_t packet_loss_hysteresis = 2;
+  uint32_t bitrate_hysteresis_kbps = 8;
+  uint32_t degrade_hold_samples = 3;
+  uint32_t recover_hold_samples = 15;
+};
+
+/**
+ * Picks encoder settings from periodic network samples. The target bitrate
+ * follows an additive-increase/multiplicative-decrease scheme: it drops by a
+ * factor as soon as a sample indicates congestion and recovers in small steps
+ * only after a run of good samples. The expected packet loss tracks the
+ * smoothed loss rate, but only changes once it is off by more than the
+ * hysteresis. Both are only applied as described for `Config`.
+ */
+class Controller {
+public:
+  Controller(const Config &config, const Settings &initial)
+      : config(config), settings(initial),
+        held_samples(config.recover_hold_samples) {
+    this->settings.bitrate_kbps =
+        std::clamp(this->settings.bitrate_kbps, config.min_bitrate_kbps,
+                   config.max_bitrate_kbps);
+    this->target_kbps = this->settings.bitrate_kbps;
+  }
+
+  /**
+   * Feeds a sample of the current round-trip time and, if any audio was
+   * received since the last sample, the loss rate observed in percent.
+   * Returns the new settings if they are to be applied.
+   */
+  std::optional<Settings> update(float rtt_ms,
+                                 std::optional<double> loss_percent) {
+    if (loss_percent.has_value()) {
+      this->smoothed_loss += (*loss_percent - this->smoothed_loss) / 4.0;
+    }
+
+    if (this->held_samples < this->config.recover_hold_samples) {
+      ++this->held_samples;
+    }
+    auto &target = this->target_kbps;
+    if (rtt_ms > this->config.rtt_high_ms ||
+        this->smoothed_loss > this->config.loss_high_percent) {
+      target = std::max(
+          this->config.min_bitrate_kbps,
+          static_cast<uint32_t>(target * this->config.decrease_factor));
+      this->good_samples = 0;
+    } else if (rtt_ms < this->config.rtt_low_ms &&
+               this->smoothed_loss < this->config.loss_high_percent / 2) {
+      if (++this->good_samples >= this->config.increase_after) {
+        target = std::min(this->config.max_bitrate_kbps,
+                          target + this->config.increase_step_kbps);
+        this->good_samples = 0;
+      }
+    } else {
+      this->good_samples = 0;
+    }
+
+    Settings next = this->settings;
+    auto bitrate_difference = target > next.bitrate_kbps
+                                  ? target - next.bitrate_kbps
+                                  : next.bitrate_kbps - target;
+    if (bitrate_difference >= this->config.bitrate_hysteresis_kbps ||
+        (bitrate_difference > 0 && (target == this->config.min_bitrate_kbps ||
+                                    target == this->config.max_bitrate_kbps))) {
+      next.bitrate_kbps = target;
+    }
+
+    auto packet_loss = std::min(
+        this->config.max_packet_loss_perc,
+        static_cast<uint32_t>(std::ceil(this->smoothed_loss)));
+    auto difference = packet_loss > next.packet_loss_perc
+                          ? packet_loss - next.packet_loss_perc
+                          : next.packet_loss_perc - packet_loss;
+    if (difference > this->config.packet_loss_hysteresis ||
+        (packet_loss == 0 && difference > 0)) {
+      next.packet_loss_perc = packet_loss;
+    }
+
+    if (next == this->settings) {
+      return std::nullopt;
+    }
+    const auto &current = this->settings;
+    const bool degrade = next.bitrate_kbps < current.bitrate_kbps ||
+                         next.packet_loss_perc > current.packet_loss_perc;
+    if (this->held_samples < (degrade ? this->config.degrade_hold_samples
+                                      : this->config.recover_hold_samples)) {
+      return std::nullopt;
+    }
+    this->settings = next;
+    this->held_samples = 0;
+    return next;
+  }
+
+  const Settings &get_settings() const { return this->settings; }
+
+private:
+  const Config config;
+  Settings settings;
+  uint32_t target_kbps;
+  uint32_t held_samples;
+  double smoothed_loss = 0.0;
+  uint32_t good_samples = 0;
+};
+
+} // namespace congestion
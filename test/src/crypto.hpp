@@ -0,0 +1,202 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <odin.h>
+
+namespace crypto {
+
+/**
+ * Counters collected by a `MeteredCipher`. Durations cover the call into the
+ * wrapped cipher only.
+ */
+struct Stats {
+  uint64_t datagrams_decrypted = 0;
+  uint64_t datagrams_rejected = 0;
+  uint64_t decrypt_ns = 0;
+  uint64_t decrypt_max_ns = 0;
+  uint64_t events = 0;
+
+  /**
+   * Returns the mean time spent per decrypted datagram since `previous`.
+   */
+  double mean_decrypt_us(const Stats &previous) const {
+    auto count = (this->datagrams_decrypted + this->datagrams_rejected) -
+                 (previous.datagrams_decrypted + previous.datagrams_rejected);
+    return count ? (this->decrypt_ns - previous.decrypt_ns) / 1000.0 / count
+                 : 0.0;
+  }
+};
+
+/**
+ * Wraps another `OdinCipher`, usually the one from `odin_crypto_create`, and
+ * measures how long it takes to decrypt each incoming datagram, which is the
+ * part of its work that scales with the number of peers speaking. Key
+ * exchange and rotation reach the cipher as events, so their count shows when
+ * the wrapped cipher had to derive new keys. Everything else is forwarded
+ * unchanged.
+ *
+ * The wrapper is handed to `odin_room_create` in place of the wrapped cipher
+ * and is freed along with it when the room releases the cipher. Functions of
+ * the crypto library that take a cipher, like `odin_crypto_get_peer_status`,
+ * still need the wrapped one.
+ */
+class MeteredCipher {
+public:
+  /**
+   * Creates a wrapper around the given cipher. The result is owned by the
+   * room it is attached to.
+   */
+  static MeteredCipher *wrap(OdinCipher *inner) {
+    return new MeteredCipher(inner);
+  }
+
+  OdinCipher *get() { return &this->cipher; }
+  OdinCipher *get_inner() const { return this->inner; }
+
+  /**
+   * Returns the counters collected so far. Safe to call from any thread.
+   */
+  Stats get_stats() const {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    Stats stats;
+    stats.datagrams_decrypted = this->datagrams_decrypted.load(relaxed);
+    stats.datagrams_rejected = this->datagrams_rejected.load(relaxed);
+    stats.decrypt_ns = this->decrypt_ns.load(relaxed);
+    stats.decrypt_max_ns = this->decrypt_max_ns.load(relaxed);
+    stats.events = this->events.load(relaxed);
+    return stats;
+  }
+
+private:
+  /**
+   * Copies the wrapped cipher, including its capacity overheads, and points
+   * every callback it implements to the forwarding one.
+   */
+  explicit MeteredCipher(OdinCipher *inner) : cipher(*inner), inner(inner) {
+    auto &c = this->cipher;
+    c.init = inner->init ? &init : nullptr;
+    c.free = &free;
+    c.on_event = inner->on_event ? &on_event : nullptr;
+    c.encrypt_datagram = inner->encrypt_datagram ? &encrypt_datagram : nullptr;
+    c.decrypt_datagram = inner->decrypt_datagram ? &decrypt_datagram : nullptr;
+    c.encrypt_message = inner->encrypt_message ? &encrypt_message : nullptr;
+    c.decrypt_message = inner->decrypt_message ? &decrypt_message : nullptr;
+    c.encrypt_user_data =
+        inner->encrypt_user_data ? &encrypt_user_data : nullptr;
+    c.decrypt_user_data =
+        inner->decrypt_user_data ? &decrypt_user_data : nullptr;
+  }
+
+  static MeteredCipher *self(OdinCipher *cipher) {
+    return reinterpret_cast<MeteredCipher *>(cipher);
+  }
+
+  static void init(OdinCipher *cipher, OdinRoom *room) {
+    auto inner = self(cipher)->inner;
+    inner->init(inner, room);
+  }
+
+  static void free(OdinCipher *cipher) {
+    auto inner = self(cipher)->inner;
+    if (inner->free) {
+      inner->free(inner);
+    }
+    delete self(cipher);
+  }
+
+  static void on_event(OdinCipher *cipher, const unsigned char *bytes,
+                       uint32_t length) {
+    auto inner = self(cipher)->inner;
+    self(cipher)->events.fetch_add(1, std::memory_order_relaxed);
+    inner->on_event(inner, bytes, length);
+  }
+
+  static int32_t decrypt_datagram(OdinCipher *cipher, uint32_t peer_id,
+                                  const unsigned char *ciphertext,
+                                  uint32_t ciphertext_length,
+                                  unsigned char *plaintext,
+                                  uint32_t plaintext_capacity) {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    auto metered = self(cipher);
+    auto started = std::chrono::steady_clock::now();
+    auto result = metered->inner->decrypt_datagram(
+        metered->inner, peer_id, ciphertext, ciphertext_length, plaintext,
+        plaintext_capacity);
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - started)
+                           .count();
+    (result < 0 ? metered->datagrams_rejected : metered->datagrams_decrypted)
+        .fetch_add(1, relaxed);
+    metered->decrypt_ns.fetch_add(elapsed, relaxed);
+    if (elapsed > metered->decrypt_max_ns.load(relaxed)) {
+      metered->decrypt_max_ns.store(elapsed, relaxed);
+    }
+    return result;
+  }
+
+  static int32_t encrypt_datagram(OdinCipher *cipher,
+                                  const unsigned char *plaintext,
+                                  uint32_t plaintext_length,
+                                  unsigned char *ciphertext,
+                                  uint32_t ciphertext_capacity) {
+    auto inner = self(cipher)->inner;
+    return inner->encrypt_datagram(inner, plaintext, plaintext_length,
+                                   ciphertext, ciphertext_capacity);
+  }
+
+  static int32_t encrypt_message(OdinCipher *cipher,
+                                 const unsigned char *plaintext,
+                                 uint32_t plaintext_length,
+                                 unsigned char *ciphertext,
+                                 uint32_t ciphertext_capacity) {
+    auto inner = self(cipher)->inner;
+    return inner->encrypt_message(inner, plaintext, plaintext_length,
+                                  ciphertext, ciphertext_capacity);
+  }
+
+  static int32_t decrypt_message(OdinCipher *cipher, uint32_t peer_id,
+                                 const unsigned char *ciphertext,
+                                 uint32_t ciphertext_length,
+                                 unsigned char *plaintext,
+                                 uint32_t plaintext_capacity) {
+    auto inner = self(cipher)->inner;
+    return inner->decrypt_message(inner, peer_id, ciphertext,
+                                  ciphertext_length, plaintext,
+                                  plaintext_capacity);
+  }
+
+  static int32_t encrypt_user_data(OdinCipher *cipher,
+                                   const unsigned char *plaintext,
+                                   uint32_t plaintext_length,
+                                   unsigned char *ciphertext,
+                                   uint32_t ciphertext_capacity) {
+    auto inner = self(cipher)->inner;
+    return inner->encrypt_user_data(inner, plaintext, plaintext_length,
+                                    ciphertext, ciphertext_capacity);
+  }
+
+  static int32_t decrypt_user_data(OdinCipher *cipher, uint32_t peer_id,
+                                   const unsigned char *ciphertext,
+                                   uint32_t ciphertext_length,
+                                   unsigned char *plaintext,
+                                   uint32_t plaintext_capacity) {
+    auto inner = self(cipher)->inner;
+    return inner->decrypt_user_data(inner, peer_id, ciphertext,
+                                    ciphertext_length, plaintext,
+                                    plaintext_capacity);
+  }
+
+  // must stay the first member, the callbacks cast it back to the wrapper
+  OdinCipher cipher;
+  OdinCipher *inner;
+  std::atomic<uint64_t> datagrams_decrypted{0};
+  std::atomic<uint64_t> datagrams_rejected{0};
+  std::atomic<uint64_t> decrypt_ns{0};
+  std::atomic<uint64_t> decrypt_max_ns{0};
+  std::atomic<uint64_t> events{0};
+};
+
+} // namespace crypto
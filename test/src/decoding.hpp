@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <odin.h>
+
+#include "mixer.hpp"
+
+namespace decoding {
+
+/**
+ * Pops the next block from a set of ODIN decoders on a pool of worker threads
+ * while the audio thread is busy elsewhere, so its own cost stays flat as the
+ * number of speakers grows. Decoders are claimed one at a time from a shared
+ * ticket counter, which lets idle threads pick up whatever is left; the thread
+ * that calls `finish` joins in rather than just waiting, so a batch completes
+ * even if the workers were not scheduled in time. Tickets only ever grow and
+ * each batch covers the range following the previous one, so a worker that
+ * is late for one batch can never claim a ticket of the next.
+ *
+ * Storage for `max_decoders` blocks of `max_samples_count` samples is
+ * reserved up front; neither `start` nor `finish` allocates. Decoders beyond
+ * that limit are left for the caller to pop itself.
+ */
+class DecoderGroup {
+public:
+  DecoderGroup(std::size_t threads_count, std::size_t max_decoders,
+               std::size_t max_samples_count)
+      : max_decoders(max_decoders), max_samples_count(max_samples_count),
+        decoders(max_decoders), silent(std::make_unique<bool[]>(max_decoders)),
+        samples(max_decoders * max_samples_count) {
+    for (std::size_t i = 0; i < threads_count; ++i) {
+      this->workers.emplace_back([this] { this->run(); });
+    }
+  }
+
+  DecoderGroup(const DecoderGroup &) = delete;
+  DecoderGroup &operator=(const DecoderGroup &) = delete;
+
+  ~DecoderGroup() {
+    this->finish();
+    this->running.store(false, std::memory_order_relaxed);
+    this->generation.fetch_add(1, std::memory_order_release);
+    this->generation.notify_all();
+    for (auto &worker : this->workers) {
+      worker.join();
+    }
+  }
+
+  /**
+   * Hands a new batch to the workers, popping `samples_count` samples from
+   * every decoder in the given range. The range is iterated like in
+   * `mixer::Mixer::mix` and must not be modified until `finish` returned.
+   * Decoders for which `skip` returns `true` are not popped and yield a
+   * silent block.
+   */
+  template <typename Decoders, typename Skip>
+  void start(const Decoders &decoders, uint32_t samples_count, Skip &&skip) {
+    std::size_t count = 0;
+    for (const auto &[key, value] : decoders) {
+      if (count == this->max_decoders) {
+        break;
+      }
+      this->decoders[count++] =
+          skip(value) ? nullptr : mixer::detail::deref(value).ptr.get();
+    }
+    this->samples_count = std::min<std::size_t>(samples_count,
+                                                this->max_samples_count);
+    this->count = count;
+    this->begin = this->end.load(std::memory_order_relaxed);
+    this->end.store(this->begin + count, std::memory_order_release);
+    this->generation.fetch_add(1, std::memory_order_release);
+    this->generation.notify_all();
+  }
+
+  template <typename Decoders>
+  void start(const Decoders &decoders, uint32_t samples_count) {
+    this->start(decoders, samples_count, [](const auto &) { return false; });
+  }
+
+  /**
+   * Pops whatever the workers have not claimed yet on the calling thread and
+   * waits for the rest of the batch to complete.
+   */
+  void finish() {
+    this->work();
+    const auto end = this->end.load(std::memory_order_relaxed);
+    while (this->completed.load(std::memory_order_acquire) < end) {
+      std::this_thread::yield();
+    }
+  }
+
+  /**
+   * Returns the number of decoders in the last batch and the number of
+   * samples popped from each of them.
+   */
+  std::size_t size() const { return this->count; }
+  std::size_t block_size() const { return this->samples_count; }
+
+  /**
+   * Returns the largest number of samples popped per decoder and batch.
+   */
+  std::size_t max_block_size() const { return this->max_samples_count; }
+
+  /**
+   * Returns the block popped from the decoder at `index` in the last batch.
+   * Only valid after `finish` returned.
+   */
+  const float *get_samples(std::size_t index, bool &is_silent) const {
+    is_silent = this->silent[index];
+    return &this->samples[index * this->max_samples_count];
+  }
+
+private:
+  void run() {
+    auto seen = this->generation.load(std::memory_order_acquire);
+    for (;;) {
+      this->generation.wait(seen, std::memory_order_acquire);
+      seen = this->generation.load(std::memory_order_acquire);
+      if (!this->running.load(std::memory_order_relaxed)) {
+        return;
+      }
+      this->work();
+    }
+  }
+
+  void work() {
+    for (;;) {
+      const auto end = this->end.load(std::memory_order_acquire);
+      auto ticket = this->next.load(std::memory_order_relaxed);
+      do {
+        if (ticket >= end) {
+          return;
+        }
+      } while (!this->next.compare_exchange_weak(ticket, ticket + 1,
+                                                 std::memory_order_relaxed));
+      const auto index = static_cast<std::size_t>(ticket - this->begin);
+      bool is_silent = true;
+      if (this->decoders[index] &&
+          odin_decoder_pop(this->decoders[index],
+                           &this->samples[index * this->max_samples_count],
+                           static_cast<uint32_t>(this->samples_count),
+                           &is_silent) != ODIN_ERROR_SUCCESS) {
+        is_silent = true;
+      }
+      this->silent[index] = is_silent;
+      this->completed.fetch_add(1, std::memory_order_release);
+    }
+  }
+
+  const std::size_t max_decoders;
+  const std::size_t max_samples_count;
+  std::vector<OdinDecoder *> decoders;
+  std::unique_ptr<bool[]> silent;
+  std::vector<float> samples;
+  std::size_t count = 0;
+  std::size_t samples_count = 0;
+  uint64_t begin = 0;
+
+  std::atomic<uint64_t> end{0};
+  std::atomic<uint64_t> next{0};
+  std::atomic<uint64_t> completed{0};
+  std::atomic<uint64_t> generation{0};
+  std::atomic<bool> running{true};
+  std::vector<std::thread> workers;
+};
+
+} // namespace decoding
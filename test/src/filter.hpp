@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <odin.h>
+
+#include "rcu.hpp"
+
+namespace filter {
+
+/**
+ * Decides on the network thread whether an incoming datagram is worth
+ * queueing at all, based on nothing but the properties ODIN hands to the
+ * datagram callback. Each peer can be restricted to a mask of channels it is
+ * heard on; datagrams that carry none of those channels are dropped before
+ * they are copied, routed or decoded. Peers without a rule are accepted.
+ *
+ * Rules are kept as a sorted snapshot in an `rcu::Cell`, so the check is a
+ * lock-free binary search, while rules can be changed from any other thread.
+ */
+class DatagramFilter {
+public:
+  using Rule = std::pair<uint32_t, uint64_t>;
+  using Rules = std::vector<Rule>;
+
+  /**
+   * Sets the channels the given peer is heard on; a mask of zero mutes the
+   * peer entirely.
+   */
+  void set(uint32_t peer_id, uint64_t channel_mask) {
+    this->rules.update([&](Rules &rules) {
+      auto it = std::lower_bound(rules.begin(), rules.end(),
+                                 Rule{peer_id, 0}, compare);
+      if (it != rules.end() && it->first == peer_id) {
+        it->second = channel_mask;
+      } else {
+        rules.insert(it, Rule{peer_id, channel_mask});
+      }
+    });
+  }
+
+  /**
+   * Removes the rule for the given peer, if any, so all of its datagrams are
+   * accepted again.
+   */
+  void remove(uint32_t peer_id) {
+    this->rules.update([&](Rules &rules) {
+      auto it = std::lower_bound(rules.begin(), rules.end(),
+                                 Rule{peer_id, 0}, compare);
+      if (it != rules.end() && it->first == peer_id) {
+        rules.erase(it);
+      }
+    });
+  }
+
+  /**
+   * Returns whether a datagram with the given properties should be kept.
+   */
+  bool accept(const OdinDatagramProperties &properties) {
+    bool accepted = true;
+    {
+      auto rules = this->rules.read();
+      auto it = std::lower_bound(rules->begin(), rules->end(),
+                                 Rule{properties.peer_id, 0}, compare);
+      if (it != rules->end() && it->first == properties.peer_id) {
+        accepted = (it->second & properties.channel_mask) != 0;
+      }
+    }
+    if (!accepted) {
+      this->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    return accepted;
+  }
+
+  /**
+   * Returns the number of datagrams dropped so far.
+   */
+  uint64_t dropped_count() const {
+    return this->dropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  static bool compare(const Rule &a, const Rule &b) {
+    return a.first < b.first;
+  }
+
+  rcu::Cell<Rules> rules;
+  std::atomic<uint64_t> dropped{0};
+};
+
+} // namespace filter
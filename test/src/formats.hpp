@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include <odin.h>
+
+#include "mixer.hpp"
+
+/**
+ * Push and pop wrappers for applications that keep their audio as signed
+ * 16-bit or planar float samples, e.g. a console audio engine or a server-side
+ * recorder. The test client itself mixes interleaved float and only runs these
+ * through its benchmarks; they convert with the kernels in `mixer`.
+ */
+namespace formats {
+
+// ─── ENCODER AND DECODER FORMATS ─────────────────────────────────────────────
+
+namespace detail {
+
+/**
+ * Number of samples converted per call into ODIN. Buffers in other formats
+ * pass through a scratch block of this size on the stack instead of a heap
+ * allocation sized to the whole buffer. It is a multiple of both channel
+ * counts ODIN supports, so blocks never split a frame.
+ */
+inline constexpr std::size_t conversion_block_size = 2880;
+inline constexpr uint32_t max_channels = 2;
+
+} // namespace detail
+
+/**
+ * Pushes interleaved signed 16-bit samples into an encoder.
+ */
+inline OdinError encoder_push_i16(OdinEncoder *encoder, const int16_t *samples,
+                                  uint32_t samples_count) {
+  float block[detail::conversion_block_size];
+  for (uint32_t offset = 0; offset < samples_count;) {
+    auto count = std::min<uint32_t>(samples_count - offset, std::size(block));
+    mixer::from_i16(samples + offset, block, count);
+    auto error = odin_encoder_push(encoder, block, count);
+    if (error != ODIN_ERROR_SUCCESS) {
+      return error;
+    }
+    offset += count;
+  }
+  return ODIN_ERROR_SUCCESS;
+}
+
+/**
+ * Pushes `frames_count` frames held in one float buffer per channel into an
+ * encoder with one or two channels.
+ */
+inline OdinError encoder_push_planar(OdinEncoder *encoder,
+                                     const float *const *planes,
+                                     uint32_t channels, uint32_t frames_count) {
+  float block[detail::conversion_block_size];
+  const float *offset_planes[detail::max_channels];
+  if (channels == 0 || channels > detail::max_channels) {
+    return ODIN_ERROR_ARGUMENT_OUT_OF_BOUNDS;
+  }
+  const uint32_t block_frames = std::size(block) / channels;
+  for (uint32_t offset = 0; offset < frames_count;) {
+    auto frames = std::min(frames_count - offset, block_frames);
+    for (uint32_t channel = 0; channel < channels; ++channel) {
+      offset_planes[channel] = planes[channel] + offset;
+    }
+    mixer::interleave(offset_planes, channels, block, frames);
+    auto error = odin_encoder_push(encoder, block, frames * channels);
+    if (error != ODIN_ERROR_SUCCESS) {
+      return error;
+    }
+    offset += frames;
+  }
+  return ODIN_ERROR_SUCCESS;
+}
+
+/**
+ * Pops interleaved signed 16-bit samples from a decoder. The block counts as
+ * silent only if all of it was.
+ */
+inline OdinError decoder_pop_i16(OdinDecoder *decoder, int16_t *out_samples,
+                                 uint32_t samples_count, bool *out_is_silent) {
+  float block[detail::conversion_block_size];
+  *out_is_silent = true;
+  for (uint32_t offset = 0; offset < samples_count;) {
+    auto count = std::min<uint32_t>(samples_count - offset, std::size(block));
+    bool is_silent = true;
+    auto error = odin_decoder_pop(decoder, block, count, &is_silent);
+    if (error != ODIN_ERROR_SUCCESS) {
+      return error;
+    }
+    mixer::to_i16(block, out_samples + offset, count);
+    *out_is_silent = *out_is_silent && is_silent;
+    offset += count;
+  }
+  return ODIN_ERROR_SUCCESS;
+}
+
+/**
+ * Pops `frames_count` frames from a decoder with one or two channels into one
+ * float buffer per channel. The block counts as silent only if all of it was.
+ */
+inline OdinError decoder_pop_planar(OdinDecoder *decoder, float *const *planes,
+                                    uint32_t channels, uint32_t frames_count,
+                                    bool *out_is_silent) {
+  float block[detail::conversion_block_size];
+  float *offset_planes[detail::max_channels];
+  if (channels == 0 || channels > detail::max_channels) {
+    return ODIN_ERROR_ARGUMENT_OUT_OF_BOUNDS;
+  }
+  const uint32_t block_frames = std::size(block) / channels;
+  *out_is_silent = true;
+  for (uint32_t offset = 0; offset < frames_count;) {
+    auto frames = std::min(frames_count - offset, block_frames);
+    bool is_silent = true;
+    auto error =
+        odin_decoder_pop(decoder, block, frames * channels, &is_silent);
+    if (error != ODIN_ERROR_SUCCESS) {
+      return error;
+    }
+    for (uint32_t channel = 0; channel < channels; ++channel) {
+      offset_planes[channel] = planes[channel] + offset;
+    }
+    mixer::deinterleave(block, offset_planes, channels, frames);
+    *out_is_silent = *out_is_silent && is_silent;
+    offset += frames;
+  }
+  return ODIN_ERROR_SUCCESS;
+}
+
+} // namespace formats
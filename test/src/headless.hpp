@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <numbers>
+#include <optional>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <miniaudio.h>
+
+#include "mixer.hpp"
+
+namespace headless {
+
+// ─── CAPTURE SOURCES ─────────────────────────────────────────────────────────
+
+/**
+ * Interleaved audio loaded into memory once, so any number of simulated peers
+ * can loop over it without touching the file system on the timer thread.
+ */
+struct Clip {
+  std::vector<float> samples;
+  uint32_t sample_rate;
+  uint32_t channels;
+};
+
+/**
+ * Loads an audio file into memory at the given sample rate and channel count.
+ * Files ending in `.raw` or `.pcm` are read as headerless signed 16-bit
+ * little-endian PCM in the target format, everything else is handed to the
+ * miniaudio decoder (WAV, FLAC and MP3).
+ */
+inline std::optional<Clip> load_clip(const std::filesystem::path &path,
+                                     uint32_t sample_rate, uint32_t channels) {
+  Clip clip{{}, sample_rate, channels};
+
+  auto extension = path.extension().string();
+  if (extension == ".raw" || extension == ".pcm") {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+      return std::nullopt;
+    }
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+    std::vector<int16_t> pcm(bytes.size() / sizeof(int16_t));
+    for (std::size_t i = 0; i < pcm.size(); ++i) {
+      auto lo = static_cast<uint8_t>(bytes[i * 2]);
+      auto hi = static_cast<uint8_t>(bytes[i * 2 + 1]);
+      pcm[i] = static_cast<int16_t>(lo | (hi << 8));
+    }
+    clip.samples.resize(pcm.size());
+    mixer::from_i16(pcm.data(), clip.samples.data(), pcm.size());
+    return clip;
+  }
+
+  ma_decoder decoder;
+  auto config = ma_decoder_config_init(ma_format_f32, channels, sample_rate);
+  if (ma_decoder_init_file(path.string().c_str(), &config, &decoder) !=
+      MA_SUCCESS) {
+    return std::nullopt;
+  }
+  float chunk[4096];
+  for (;;) {
+    ma_uint64 frames_read = 0;
+    ma_decoder_read_pcm_frames(&decoder, chunk, std::size(chunk) / channels,
+                               &frames_read);
+    if (frames_read == 0) {
+      break;
+    }
+    clip.samples.insert(clip.samples.end(), chunk,
+                        chunk + frames_read * channels);
+  }
+  ma_decoder_uninit(&decoder);
+  return clip;
+}
+
+/**
+ * Produces capture audio for a simulated peer, either by looping a shared
+ * clip or by synthesizing a tone with alternating talk and pause segments
+ * so voice activity detection behaves like it would for a real speaker.
+ */
+class Source {
+public:
+  Source(std::shared_ptr<const Clip> clip, std::size_t offset)
+      : clip(std::move(clip)), position(offset) {}
+
+  Source(float frequency_hz, uint32_t sample_rate, uint32_t channels)
+      : frequency_hz(frequency_hz), sample_rate(sample_rate),
+        channels(channels) {}
+
+  /**
+   * Fills `samples` with the next `samples_count` interleaved samples.
+   */
+  void read(float *samples, std::size_t samples_count) {
+    if (this->clip && !this->clip->samples.empty()) {
+      const auto &source = this->clip->samples;
+      for (std::size_t i = 0; i < samples_count; ++i) {
+        samples[i] = source[this->position++ % source.size()];
+      }
+      return;
+    }
+
+    const auto talk_frames = this->sample_rate * 3;
+    const auto cycle_frames = this->sample_rate * 5;
+    const auto step =
+        2.0 * std::numbers::pi * this->frequency_hz / this->sample_rate;
+    for (std::size_t i = 0; i < samples_count; i += this->channels) {
+      auto frame = this->position++;
+      float value = 0.0f;
+      if (frame % cycle_frames < talk_frames) {
+        value = 0.25f * static_cast<float>(std::sin(step * frame));
+      }
+      std::fill_n(samples + i, std::min<std::size_t>(this->channels,
+                                                     samples_count - i),
+                  value);
+    }
+  }
+
+private:
+  std::shared_ptr<const Clip> clip;
+  std::size_t position = 0;
+  float frequency_hz = 0.0f;
+  uint32_t sample_rate = 48000;
+  uint32_t channels = 1;
+};
+
+// ─── PLAYBACK SINKS ──────────────────────────────────────────────────────────
+
+/**
+ * Consumes playback audio for a simulated peer. Without a path all samples
+ * are discarded, otherwise they are written to a WAV file.
+ */
+class Sink {
+public:
+  Sink() = default;
+  Sink(Sink &&) = default;
+  Sink &operator=(Sink &&) = delete;
+  ~Sink() {
+    if (this->encoder) {
+      ma_encoder_uninit(this->encoder.get());
+    }
+  }
+
+  bool open(const std::filesystem::path &path, uint32_t sample_rate,
+            uint32_t channels) {
+    auto config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_f32,
+                                         channels, sample_rate);
+    auto encoder = std::make_unique<ma_encoder>();
+    if (ma_encoder_init_file(path.string().c_str(), &config, encoder.get()) !=
+        MA_SUCCESS) {
+      return false;
+    }
+    this->encoder = std::move(encoder);
+    this->channels = channels;
+    return true;
+  }
+
+  void write(const float *samples, std::size_t samples_count) {
+    if (this->encoder) {
+      ma_encoder_write_pcm_frames(this->encoder.get(), samples,
+                                  samples_count / this->channels, nullptr);
+    }
+  }
+
+private:
+  std::unique_ptr<ma_encoder> encoder;
+  uint32_t channels = 1;
+};
+
+// ─── MEASUREMENTS ────────────────────────────────────────────────────────────
+
+/**
+ * Collects duration samples and reports percentiles at the end of a run. The
+ * storage is reserved up front so recording never allocates on the timer
+ * thread until the reserved capacity is exhausted.
+ */
+class Percentiles {
+public:
+  explicit Percentiles(std::size_t reserve) { this->samples.reserve(reserve); }
+
+  void record(std::chrono::nanoseconds value) {
+    this->samples.push_back(value.count());
+  }
+
+  /**
+   * Returns the value at the given percentile (0-100) in microseconds.
+   */
+  double get_us(double percentile) {
+    if (this->samples.empty()) {
+      return 0.0;
+    }
+    auto index = static_cast<std::size_t>(
+        std::clamp(percentile / 100.0, 0.0, 1.0) * (this->samples.size() - 1));
+    std::nth_element(this->samples.begin(), this->samples.begin() + index,
+                     this->samples.end());
+    return this->samples[index] / 1000.0;
+  }
+
+private:
+  std::vector<int64_t> samples;
+};
+
+/**
+ * Returns the CPU time consumed by all threads of the process so far, i.e.
+ * user and kernel time. Unlike `std::clock()`, which reports wall time on
+ * Windows, this only advances while the process is actually running.
+ */
+inline std::chrono::nanoseconds process_cpu_time() {
+#ifdef _WIN32
+  FILETIME created, exited, kernel, user;
+  if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel,
+                       &user)) {
+    return {};
+  }
+  auto to_ticks = [](const FILETIME &time) {
+    return (static_cast<uint64_t>(time.dwHighDateTime) << 32) |
+           time.dwLowDateTime;
+  };
+  // FILETIME counts in units of 100 ns
+  return std::chrono::nanoseconds(
+      static_cast<int64_t>((to_ticks(kernel) + to_ticks(user)) * 100));
+#else
+  timespec time;
+  if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) != 0) {
+    return {};
+  }
+  return std::chrono::seconds(time.tv_sec) +
+         std::chrono::nanoseconds(time.tv_nsec);
+#endif
+}
+
+} // namespace headless
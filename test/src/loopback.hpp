@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <odin.h>
+
+#include "api.hpp"
+#include "rcu.hpp"
+
+namespace loopback {
+
+/**
+ * In-process stand-in for an ODIN room, which allows benchmarking encoders,
+ * decoders and everything in between without a server or network. Peers
+ * register the same `OdinRoomEvents` they would pass to `odin_room_create`
+ * and receive synthesized `Joined`, `PeerJoined`, `PeerLeft`, `PeerChanged`
+ * and `MessageReceived` events as well as datagrams forwarded from all other
+ * peers, honoring the channel masks they joined with and any changes sent
+ * through `SetChannelMasks`. Callbacks are invoked with a null room handle on
+ * the thread calling into the room.
+ *
+ * Datagrams may be sent from any number of threads while peers join, leave
+ * and send RPCs on another one; the peer list is published through
+ * `rcu::Cell`. Delivery of datagrams is serialized, so like with the network
+ * thread of a real room, `on_datagram` of a peer is never entered by two
+ * threads at once.
+ */
+class Room {
+public:
+  explicit Room(std::string room_id) : room_id(std::move(room_id)) {}
+
+  /**
+   * Adds a peer to the room and returns its peer id. The new peer receives
+   * `Joined` followed by `PeerJoined` for everyone already in the room, who
+   * are notified about the new peer in turn. Like the `channel_masks` of the
+   * authentication passed to `odin_room_create`, the given masks limit the
+   * channels the new peer hears from others.
+   */
+  api::PeerId
+  join(const OdinRoomEvents &events, const std::string &user_id,
+       std::vector<std::pair<api::PeerId, api::ChannelMask>> channel_masks =
+           {}) {
+    auto peer_id = this->next_peer_id.fetch_add(1);
+
+    emit(events, "Joined",
+         api::server::Joined{peer_id, this->room_id, "<loopback>"});
+    {
+      auto peers = this->peers.read();
+      for (const auto &peer : *peers) {
+        emit(events, "PeerJoined",
+             api::server::PeerJoined{peer.peer_id, peer.user_id});
+        emit(peer.events, "PeerJoined",
+             api::server::PeerJoined{peer_id, user_id});
+      }
+    }
+
+    this->peers.update([&](std::vector<Peer> &peers) {
+      peers.push_back(Peer{peer_id, user_id, events, channel_masks});
+    });
+    return peer_id;
+  }
+
+  /**
+   * Removes a peer from the room and notifies everyone else.
+   */
+  void leave(api::PeerId peer_id) {
+    this->peers.update([&](std::vector<Peer> &peers) {
+      std::erase_if(peers,
+                    [&](const Peer &peer) { return peer.peer_id == peer_id; });
+    });
+    auto peers = this->peers.read();
+    for (const auto &peer : *peers) {
+      emit(peer.events, "PeerLeft", api::server::PeerLeft{peer_id});
+    }
+  }
+
+  /**
+   * Forwards a voice datagram to all other peers whose channel masks for the
+   * sender include the first channel.
+   */
+  void send_datagram(api::PeerId sender_peer_id, const uint8_t *bytes,
+                     uint32_t bytes_length) {
+    std::lock_guard lock(this->datagram_mutex);
+    OdinDatagramProperties properties{};
+    properties.peer_id = sender_peer_id;
+    properties.channel_mask = 1;
+
+    auto peers = this->peers.read();
+    for (const auto &peer : *peers) {
+      if (peer.peer_id != sender_peer_id &&
+          (peer.channel_mask(sender_peer_id) & properties.channel_mask)) {
+        peer.events.on_datagram(nullptr, &properties, bytes, bytes_length,
+                                peer.events.user_data);
+      }
+    }
+  }
+
+  /**
+   * Handles a JSON encoded client command sent by the given peer.
+   */
+  void send_rpc(api::PeerId sender_peer_id, const std::string &json) {
+    auto rpc = nlohmann::json::parse(json);
+    const auto &name = rpc.cbegin().key();
+    const auto &args = rpc.cbegin().value();
+
+    if (name == "SetChannelMasks") {
+      auto command = args.get<api::client::SetChannelMasks>();
+      this->peers.update([&](std::vector<Peer> &peers) {
+        for (auto &peer : peers) {
+          if (peer.peer_id == sender_peer_id) {
+            if (command.reset) {
+              peer.channel_masks.clear();
+            }
+            for (const auto &mask : command.masks) {
+              std::erase_if(peer.channel_masks, [&](const auto &existing) {
+                return existing.first == mask.first;
+              });
+              peer.channel_masks.push_back(mask);
+            }
+          }
+        }
+      });
+    } else if (name == "SendMessage") {
+      auto command = args.get<api::client::SendMessage>();
+      auto peers = this->peers.read();
+      for (const auto &peer : *peers) {
+        if (peer.peer_id != sender_peer_id &&
+            (!command.peer_ids.has_value() ||
+             std::ranges::count(*command.peer_ids, peer.peer_id))) {
+          emit(peer.events, "MessageReceived",
+               nlohmann::json{{"sender_peer_id", sender_peer_id},
+                              {"message", std::vector<uint8_t>(
+                                              command.message.begin(),
+                                              command.message.end())}});
+        }
+      }
+    } else if (name == "ChangeSelf") {
+      auto command = args.get<api::client::ChangeSelf>();
+      auto peers = this->peers.read();
+      for (const auto &peer : *peers) {
+        if (peer.peer_id != sender_peer_id) {
+          emit(peer.events, "PeerChanged",
+               api::server::PeerChanged{sender_peer_id, command.user_data});
+        }
+      }
+    }
+  }
+
+private:
+  struct Peer {
+    api::PeerId peer_id;
+    std::string user_id;
+    OdinRoomEvents events;
+    std::vector<std::pair<api::PeerId, api::ChannelMask>> channel_masks;
+
+    /**
+     * Returns the channels this peer wants to hear from the given sender;
+     * without an explicit mask, all channels are enabled.
+     */
+    api::ChannelMask channel_mask(api::PeerId sender_peer_id) const {
+      for (const auto &[peer_id, mask] : this->channel_masks) {
+        if (peer_id == sender_peer_id) {
+          return mask;
+        }
+      }
+      return ~api::ChannelMask{0};
+    }
+  };
+
+  template <typename Event>
+  static void emit(const OdinRoomEvents &events, const char *name,
+                   const Event &event) {
+    auto json = nlohmann::json{{name, event}}.dump();
+    events.on_rpc(nullptr, json.c_str(), events.user_data);
+  }
+
+  const std::string room_id;
+  std::atomic<api::PeerId> next_peer_id{1};
+  rcu::Cell<std::vector<Peer>> peers;
+  std::mutex datagram_mutex;
+};
+
+} // namespace loopback
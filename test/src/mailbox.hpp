@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+
+namespace mailbox {
+
+/**
+ * Holds the latest value of a trivially copyable configuration struct, which
+ * control threads publish and a real-time thread picks up at its own pace.
+ * Publishing follows the seqlock pattern: the sequence number is odd while a
+ * writer copies the value in and becomes even again once it is complete. The
+ * reader never waits for a writer; if it catches one mid-publish or the value
+ * changes under its feet, it gives up for now, counts the deferral and takes
+ * the value on its next attempt. The payload is stored as relaxed atomic
+ * words, so a torn read is detected rather than being a data race.
+ */
+template <typename T> class Mailbox {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Mailbox values must be trivially copyable");
+
+public:
+  /**
+   * Sequence number a reader should start with to take the current value on
+   * its first attempt, since published sequence numbers are always even.
+   */
+  static constexpr uint64_t initial_generation = ~uint64_t{0};
+
+  explicit Mailbox(const T &initial = T{}) { this->store(initial); }
+
+  Mailbox(const Mailbox &) = delete;
+  Mailbox &operator=(const Mailbox &) = delete;
+
+  /**
+   * Replaces the current value. Writers are serialized with a mutex, which
+   * the reading side never touches.
+   */
+  void publish(const T &value) {
+    std::lock_guard<std::mutex> lock(this->writer_mutex);
+    const auto sequence = this->sequence.load(std::memory_order_relaxed);
+    this->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    this->store(value);
+    this->sequence.store(sequence + 2, std::memory_order_release);
+    this->published.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Copies the current value into `out` if it was published after the value
+   * identified by `generation`, which is updated accordingly. Returns `false`
+   * if there is nothing new or a writer is busy; wait-free in either case.
+   */
+  bool try_take(T &out, uint64_t &generation) {
+    const auto sequence = this->sequence.load(std::memory_order_acquire);
+    if (sequence == generation) {
+      return false;
+    }
+    if (sequence & 1) {
+      this->deferred.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    T value;
+    this->load(value);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (this->sequence.load(std::memory_order_relaxed) != sequence) {
+      this->deferred.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    out = value;
+    generation = sequence;
+    this->taken.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * Returns the number of values published, taken by readers and the number
+   * of times a reader deferred because a writer was busy.
+   */
+  uint64_t published_count() const {
+    return this->published.load(std::memory_order_relaxed);
+  }
+  uint64_t taken_count() const {
+    return this->taken.load(std::memory_order_relaxed);
+  }
+  uint64_t deferred_count() const {
+    return this->deferred.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr std::size_t words_count =
+      (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  void store(const T &value) {
+    uint64_t words[words_count] = {};
+    std::memcpy(words, &value, sizeof(T));
+    for (std::size_t i = 0; i < words_count; ++i) {
+      this->words[i].store(words[i], std::memory_order_relaxed);
+    }
+  }
+
+  void load(T &value) const {
+    uint64_t words[words_count];
+    for (std::size_t i = 0; i < words_count; ++i) {
+      words[i] = this->words[i].load(std::memory_order_relaxed);
+    }
+    std::memcpy(&value, words, sizeof(T));
+  }
+
+  std::atomic<uint64_t> sequence{0};
+  std::atomic<uint64_t> words[words_count];
+  std::atomic<uint64_t> published{0};
+  std::atomic<uint64_t> taken{0};
+  std::atomic<uint64_t> deferred{0};
+  std::mutex writer_mutex;
+};
+
+} // namespace mailbox
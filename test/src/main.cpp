@@ -6,11 +6,21 @@
  */
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include <cxxopts.hpp>
@@ -24,11 +34,34 @@
 #include <odin_crypto.h>
 
 #include "api.hpp"
+#include "congestion.hpp"
+#include "crypto.hpp"
+#include "decoding.hpp"
+#include "filter.hpp"
+#include "headless.hpp"
+#include "loopback.hpp"
+#include "mailbox.hpp"
+#include "mixer.hpp"
+#include "playout.hpp"
+#include "profiler.hpp"
+#include "queue.hpp"
+#include "rcu.hpp"
+#include "selection.hpp"
+#include "spatial.hpp"
+#include "stats.hpp"
+#include "tokens.hpp"
 
 #define ODIN_ACCESS_KEY_FILE "odin_access_key.txt"
 #define ODIN_DEFAULT_GW_ADDR "gateway.odin.4players.io"
 #define ODIN_DEFAULT_ROOM_ID "default"
 #define ODIN_DEFAULT_USER_ID "My User ID"
+#define ODIN_MAX_DATAGRAM_SIZE 2048
+#define ODIN_DATAGRAM_QUEUE_CAPACITY 512
+#define ODIN_RPC_QUEUE_CAPACITY 256
+#define ODIN_CAPTURE_BLOCK_SIZE 2048
+#define ODIN_CAPTURE_QUEUE_CAPACITY 64
+#define ODIN_DECODER_GROUP_CAPACITY 128
+#define ODIN_POSITION_UPDATE_INTERVAL_MS 500
 
 template <class T> using OpaquePtr = std::unique_ptr<T, void (*)(T *)>;
 
@@ -119,7 +152,31 @@ void init_arguments(int argc, char *argv[]) {
       // --disable-vad
       ("disable-vad", "disable built-in voice activity detection effects")
       // --disable-apm
-      ("disable-apm", "disable built-in audio processing module effects");
+      ("disable-apm", "disable built-in audio processing module effects")
+      // --limiter-threshold <number>
+      ("limiter-threshold", "peak level at which the output limiter engages",
+       cxxopts::value<float>()->default_value("0.9"))
+      // --profile-effects
+      ("profile-effects", "measure time spent in each capture pipeline effect")
+      // --async-encoder
+      ("async-encoder", "encode captured audio on a worker thread")
+      // --encoder-bitrate <number>
+      ("encoder-bitrate", "target bitrate of the voice encoder in kbps",
+       cxxopts::value<int>()->default_value("32"))
+      // --encoder-packet-loss <number>
+      ("encoder-packet-loss",
+       "expected packet loss in percent to add forward error correction for",
+       cxxopts::value<int>()->default_value("0"))
+      // --adaptive-bitrate
+      ("adaptive-bitrate",
+       "adapt the encoder bitrate and loss protection to network conditions")
+      // --adaptive-min-bitrate <number>
+      ("adaptive-min-bitrate", "lowest bitrate in kbps to adapt down to",
+       cxxopts::value<int>()->default_value("12"))
+      // --stats-interval <number>
+      ("stats-interval", "seconds between connection statistics reports (0 "
+                         "disables them)",
+       cxxopts::value<int>()->default_value("0"));
   options.add_options("Audio Device")
       // --audio-devices
       ("a,audio-devices", "show available audio devices and exit")
@@ -141,6 +198,49 @@ void init_arguments(int argc, char *argv[]) {
       // --input-channels <number>
       ("input-channels", "capture channel count (1-2)",
        cxxopts::value<int>()->default_value("1"));
+  options.add_options("Playout")
+      // --playout-delay <number>
+      ("playout-delay", "delay in ms added at the start of each talk spurt",
+       cxxopts::value<int>()->default_value("0"))
+      // --playout-min-delay <number>
+      ("playout-min-delay", "lower bound in ms for the adaptive playout delay",
+       cxxopts::value<int>()->default_value("0"))
+      // --playout-max-delay <number>
+      ("playout-max-delay", "upper bound in ms for the adaptive playout delay",
+       cxxopts::value<int>()->default_value("0"))
+      // --decode-threads <number>
+      ("decode-threads", "worker threads decoding peers one period ahead (0 "
+                         "decodes on the audio thread)",
+       cxxopts::value<int>()->default_value("0"))
+      // --max-speakers <number>
+      ("max-speakers", "number of loudest peers to decode and mix (0 decodes "
+                       "all peers)",
+       cxxopts::value<int>()->default_value("0"));
+  options.add_options("Proximity")
+      // --position <x,y,z>
+      ("position", "position of the local peer, e.g. 10,0,-5",
+       cxxopts::value<std::string>())
+      // --cull-radius <number>
+      ("cull-radius", "distance beyond which remote peers are not decoded (0 "
+                      "disables culling)",
+       cxxopts::value<float>()->default_value("0"));
+  options.add_options("Headless")
+      // --headless
+      ("headless", "run simulated peers without audio devices")
+      // --bots <number>
+      ("bots", "number of simulated peers to spawn in headless mode",
+       cxxopts::value<int>()->default_value("1"))
+      // --input-file <string>
+      ("input-file", "audio file (wav, flac, mp3 or raw s16le) to capture from",
+       cxxopts::value<std::string>())
+      // --output-file <string>
+      ("output-file", "wav file to write received audio to",
+       cxxopts::value<std::string>())
+      // --duration <number>
+      ("duration", "seconds to run in headless mode (0 waits for RETURN)",
+       cxxopts::value<int>()->default_value("0"))
+      // --loopback
+      ("loopback", "simulate the room in-process instead of using a server");
 
   try {
     global::arguments.emplace(options.parse(argc, argv));
@@ -178,6 +278,16 @@ void init_arguments(int argc, char *argv[]) {
     std::cout << options.help() << std::endl;
     exit(EXIT_SUCCESS);
   }
+
+  // also rejects NaN, which would silently disable the limiter
+  auto limiter_threshold =
+      (*global::arguments)["limiter-threshold"].as<float>();
+  if (!(limiter_threshold > 0.0f && limiter_threshold <= 1.0f)) {
+    std::cerr << "Error: limiter threshold must be greater than 0 and at "
+                 "most 1"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
 }
 
 /**
@@ -215,16 +325,253 @@ static void custom_effect_talk_status(float *samples, uint32_t samples_count,
   ctx->is_silent = *is_silent;
 }
 
+/**
+ * Settings of the built-in effects in the capture pipeline, which can be
+ * changed at runtime.
+ */
+struct PipelineConfig {
+  OdinApmConfig apm;
+  OdinVadConfig vad;
+};
+
 struct Encoder {
+  std::unique_ptr<profiler::PipelineProfiler> profiler;
   OpaquePtr<OdinEncoder> ptr;
   uint32_t vad_effect_id;
   uint32_t apm_effect_id;
   CustomEffectContext ctx;
+  uint64_t config_generation =
+      mailbox::Mailbox<PipelineConfig>::initial_generation;
 };
 
 struct Decoder {
   OpaquePtr<OdinDecoder> ptr;
   CustomEffectContext ctx;
+  float gain = 1.0f;
+  std::unique_ptr<playout::Buffer> playout;
+  std::unique_ptr<spatial::PeerState> spatial;
+  std::unique_ptr<selection::Speaker> speaker;
+};
+
+/**
+ * Returns whether the given decoder belongs to a peer out of range.
+ */
+bool is_culled(const Decoder &decoder) {
+  return decoder.spatial && decoder.spatial->is_culled();
+}
+
+/**
+ * Returns whether the given decoder is neither decoded nor mixed, either
+ * because its peer is out of range or not among the loudest speakers.
+ */
+bool is_idle(const Decoder &decoder) {
+  return is_culled(decoder) ||
+         (decoder.speaker && !decoder.speaker->is_selected());
+}
+
+/**
+ * Returns whether incoming datagrams are passed on to the given decoder.
+ * Peers that are not selected skip their decoder, so it does not pile up
+ * audio while nobody pops it; culled peers keep feeding theirs, as their
+ * datagrams are the only source of their positions.
+ */
+bool is_fed(const Decoder &decoder) {
+  return !decoder.speaker || decoder.speaker->is_selected() ||
+         is_culled(decoder);
+}
+
+/**
+ * Maps remote peers to their decoders. Lookups and iteration from the audio
+ * thread are lock-free: every change publishes a new sorted snapshot through
+ * `rcu::Cell` and decoders are only freed on the writing thread once no
+ * reader can observe them anymore. Readers may also keep a reference to a
+ * snapshot beyond their read section; replaced snapshots are retired rather
+ * than released, so the last reference to them and their decoders is always
+ * dropped by `collect` on the writing thread.
+ */
+class DecoderRegistry {
+public:
+  using Entry = std::pair<api::PeerId, std::shared_ptr<Decoder>>;
+  using Entries = std::vector<Entry>;
+  using Snapshot = std::shared_ptr<const Entries>;
+
+  /**
+   * Scoped read access to the current snapshot.
+   */
+  class ReadGuard {
+  public:
+    const Entries &operator*() const { return **this->guard; }
+    const Entries *operator->() const { return this->guard->get(); }
+
+    /**
+     * Returns a reference to the snapshot which stays valid after the guard
+     * is gone. Copying it neither allocates nor frees anything.
+     */
+    Snapshot share() const { return *this->guard; }
+
+  private:
+    friend class DecoderRegistry;
+    explicit ReadGuard(rcu::Cell<Snapshot>::ReadGuard guard)
+        : guard(std::move(guard)) {}
+
+    rcu::Cell<Snapshot>::ReadGuard guard;
+  };
+
+  /**
+   * Registers a decoder for the given peer, replacing any existing one.
+   */
+  void attach(api::PeerId peer_id, std::shared_ptr<Decoder> decoder) {
+    this->modify([&](Entries &entries) {
+      auto it = lower_bound(entries, peer_id);
+      if (it != entries.end() && it->first == peer_id) {
+        it->second = std::move(decoder);
+      } else {
+        entries.insert(it, {peer_id, std::move(decoder)});
+      }
+    });
+  }
+
+  /**
+   * Removes the decoder registered for the given peer, if any.
+   */
+  void detach(api::PeerId peer_id) {
+    this->modify([&](Entries &entries) {
+      auto it = lower_bound(entries, peer_id);
+      if (it != entries.end() && it->first == peer_id) {
+        entries.erase(it);
+      }
+    });
+  }
+
+  void clear() {
+    this->modify([](Entries &entries) { entries.clear(); });
+  }
+
+  /**
+   * Frees retired snapshots, and decoders only they referenced, once no
+   * reader holds on to them anymore. Called after every change and should
+   * also be called periodically on the writing thread.
+   */
+  void collect() {
+    std::erase_if(this->retired, [](const Snapshot &snapshot) {
+      return snapshot.use_count() == 1;
+    });
+  }
+
+  ReadGuard read() const { return ReadGuard(this->entries.read()); }
+
+  /**
+   * Looks up the decoder registered for the given peer in a snapshot.
+   */
+  static Decoder *find(const Entries &entries, api::PeerId peer_id) {
+    auto it = lower_bound(entries, peer_id);
+    return it != entries.end() && it->first == peer_id ? it->second.get()
+                                                       : nullptr;
+  }
+
+private:
+  template <typename F> void modify(F &&mutate) {
+    this->entries.update([&](Snapshot &snapshot) {
+      auto next = std::make_shared<Entries>(*snapshot);
+      mutate(*next);
+      this->retired.push_back(std::move(snapshot));
+      snapshot = std::move(next);
+    });
+    this->collect();
+  }
+
+  template <typename Container>
+  static auto lower_bound(Container &entries, api::PeerId peer_id)
+      -> decltype(entries.begin()) {
+    return std::lower_bound(
+        entries.begin(), entries.end(), peer_id,
+        [](const Entry &entry, api::PeerId id) { return entry.first < id; });
+  }
+
+  rcu::Cell<Snapshot> entries{std::make_shared<const Entries>()};
+  std::vector<Snapshot> retired;
+};
+
+/**
+ * A voice datagram received from the room, queued together with its
+ * properties until the audio thread routes it to a decoder.
+ */
+struct Datagram {
+  OdinDatagramProperties properties;
+  playout::Clock::time_point received;
+  uint32_t length;
+  uint8_t bytes[ODIN_MAX_DATAGRAM_SIZE];
+};
+
+/**
+ * An RPC received from the room, queued until the application thread polls
+ * it. The string keeps its capacity when the slot is reused, so the network
+ * thread stops allocating once the queue has warmed up.
+ */
+struct Rpc {
+  std::string json;
+};
+
+/**
+ * Pushes a batch of datagrams originating from the same peer into the given
+ * decoder through its playout buffer. Returns the number of datagrams the
+ * decoder accepted, including previously held ones released by this batch.
+ */
+std::size_t push_datagrams(Decoder &decoder, Datagram *const *datagrams,
+                           std::size_t datagrams_count) {
+  std::size_t accepted = 0;
+  auto deliver = [&](const uint8_t *bytes, uint32_t length) {
+    if (is_fed(decoder) && odin_decoder_push(decoder.ptr.get(), bytes,
+                                             length) == ODIN_ERROR_SUCCESS) {
+      ++accepted;
+    }
+  };
+  for (std::size_t i = 0; i < datagrams_count; ++i) {
+    decoder.playout->push(datagrams[i]->received, datagrams[i]->bytes,
+                          datagrams[i]->length, deliver);
+  }
+  if (decoder.spatial && accepted) {
+    OdinPosition position;
+    uint32_t positions_count = 1;
+    if (odin_decoder_get_positions(
+            decoder.ptr.get(),
+            odin_decoder_get_active_channels(decoder.ptr.get()), &position,
+            &positions_count) == ODIN_ERROR_SUCCESS &&
+        positions_count > 0) {
+      decoder.spatial->store_position(position);
+    }
+  }
+  return accepted;
+}
+
+/**
+ * Logs the counters collected by one or more playout buffers.
+ */
+void log_playout_stats(const std::string &label, const playout::Stats &stats) {
+  LOG_INFO("{}: {} datagrams of {:.0f} ms in {} talk spurts, jitter {:.1f} "
+           "ms, target delay {:.0f} ms, {} gaps, {} held, {} overflows, {} "
+           "underruns, {} lost ({:.1f}%)",
+           label, stats.datagrams, stats.frame_duration_ms, stats.talk_spurts,
+           stats.jitter_ms, stats.target_delay_ms, stats.gaps, stats.held,
+           stats.overflows, stats.underruns, stats.lost,
+           stats.loss_percent());
+}
+
+/**
+ * A block of captured samples, queued by the capture callback until the
+ * encoder worker pushes it into the encoder.
+ */
+struct CaptureBlock {
+  uint32_t samples_count;
+  float samples[ODIN_CAPTURE_BLOCK_SIZE];
+};
+
+/**
+ * Sample rate and channel layout of an audio stream.
+ */
+struct AudioFormat {
+  uint32_t sample_rate;
+  uint32_t channels;
 };
 
 /**
@@ -233,14 +580,72 @@ struct Decoder {
 struct State {
   OpaquePtr<OdinRoom> room;
   OdinCipher *cipher;
+  crypto::MeteredCipher *metered_cipher;
+  loopback::Room *loopback;
+  api::PeerId loopback_peer_id;
 
   ma_device playback_device;
   ma_device capture_device;
-
-  std::optional<Encoder> encoder;
-  std::unordered_map<api::PeerId, Decoder> decoders;
-
-  State();
+  AudioFormat playback_format;
+  AudioFormat capture_format;
+
+  rcu::Cell<std::shared_ptr<Encoder>> encoder;
+  std::optional<congestion::Settings> encoder_settings;
+  std::optional<congestion::Controller> bitrate_controller;
+  std::chrono::steady_clock::time_point bitrate_adapted;
+  playout::Stats bitrate_playout_stats;
+  DecoderRegistry decoders;
+  mixer::Mixer mixer;
+  DecoderRegistry::Snapshot decoded;
+  std::unique_ptr<decoding::DecoderGroup> decoder_group;
+
+  mailbox::Mailbox<PipelineConfig> pipeline_config;
+  std::atomic<bool> echo_canceller;
+
+  filter::DatagramFilter datagram_filter;
+  queue::SpscRing<Datagram> datagrams;
+  std::vector<Datagram *> datagram_batch;
+  std::vector<Datagram *> datagram_sorted;
+  std::vector<uint64_t> datagram_order;
+
+  queue::SpscRing<Rpc> rpcs;
+  std::size_t rpcs_polled;
+  std::mutex rpcs_spill_mutex;
+  std::vector<Rpc> rpcs_spill;
+  std::atomic<bool> rpcs_spilling;
+  std::atomic<uint64_t> rpcs_spilled;
+  std::vector<Rpc> rpcs_spill_polled;
+  std::size_t rpcs_spill_offset;
+
+  std::unique_ptr<queue::SpscRing<CaptureBlock>> capture_blocks;
+  std::atomic<uint64_t> capture_blocks_queued;
+  std::atomic<bool> encoder_worker_running;
+  std::thread encoder_worker;
+
+  std::atomic<uint64_t> datagrams_sent;
+  std::atomic<uint64_t> datagrams_received;
+  std::atomic<uint64_t> datagram_bytes_sent;
+  std::atomic<uint64_t> datagram_bytes_received;
+  std::atomic<uint64_t> rpc_bytes_sent;
+  std::atomic<uint64_t> rpc_bytes_received;
+  std::atomic<bool> left;
+
+  std::chrono::seconds stats_interval;
+  stats::Summary rtt;
+  std::chrono::steady_clock::time_point rtt_sampled;
+  std::chrono::steady_clock::time_point stats_logged;
+  stats::RoomStats room_stats_logged;
+  crypto::Stats cipher_stats_logged;
+  std::unordered_map<api::PeerId, playout::Stats> peer_stats_logged;
+
+  std::optional<OdinPosition> position;
+  float cull_radius;
+  std::chrono::steady_clock::time_point culled;
+
+  std::optional<selection::Selector> speaker_selector;
+
+  explicit State(std::size_t rpc_queue_capacity = ODIN_RPC_QUEUE_CAPACITY);
+  ~State();
 
   void on_room_status_changed(const std::string &status);
   void on_room_joined(const std::string &room_id, const std::string &customer,
@@ -252,8 +657,32 @@ struct State {
   void configure_encoder(const api::PeerId peer_id);
   void configure_decoder(const api::PeerId peer_id);
 
+  void adapt_encoder(std::chrono::steady_clock::time_point now);
+  void update_stats(std::chrono::steady_clock::time_point now);
+  void cull_peers(std::chrono::steady_clock::time_point now);
+  stats::RoomStats get_room_stats();
+  std::optional<stats::PeerStats>
+  get_peer_stats(api::PeerId peer_id,
+                 std::chrono::steady_clock::time_point now);
+
+  void apply_pipeline_config(Encoder &encoder, const PipelineConfig &config);
+  void submit_capture(const float *samples, uint32_t samples_count);
+  void process_capture(const float *samples, uint32_t samples_count);
+  void process_playback(float *samples, uint32_t samples_count);
+  template <typename OnPop, typename Pop>
+  void mix_decoded(float *samples, uint32_t samples_count, OnPop &&on_pop,
+                   Pop &&pop);
+  void route_datagrams(const DecoderRegistry::Entries &decoders);
+  void select_speakers(const DecoderRegistry::Entries &decoders);
+  std::size_t poll_rpcs(Rpc **out_rpcs, std::size_t max_count);
   void send_rpc(const api::client::Command);
 
+  void start_encoder_worker();
+  void stop_encoder_worker();
+  void start_decoder_group(std::size_t threads_count,
+                           std::size_t samples_count);
+  void stop_decoder_group();
+
   void start_audio_devices(int playback_device_idx,
                            int playback_device_sample_rate_hz,
                            int playback_device_channel_count,
@@ -272,53 +701,19 @@ void handle_audio_data(ma_device *device, void *output, const void *input,
                        ma_uint32 frame_count) {
   auto state = reinterpret_cast<State *>(device->pUserData);
   if (device->type == ma_device_type_capture) {
-    auto input_count = frame_count * device->capture.channels;
-
-    if (state->encoder.has_value()) {
-      odin_encoder_push(state->encoder->ptr.get(),
-                        reinterpret_cast<const float *>(input), input_count);
-      for (;;) {
-        uint8_t datagram[2048];
-        uint32_t datagram_length = sizeof(datagram);
-        switch (odin_encoder_pop(state->encoder->ptr.get(), datagram,
-                                 &datagram_length)) {
-        case ODIN_ERROR_SUCCESS:
-          CHECK(odin_room_send_datagram(state->room.get(), datagram,
-                                        datagram_length));
-          break;
-        case ODIN_ERROR_NO_DATA:
-          return;
-        default:
-          LOG_ERROR("failed to encode audio datagram to send");
-        };
-      }
-    }
+    state->submit_capture(reinterpret_cast<const float *>(input),
+                          frame_count * device->capture.channels);
   } else if (device->type == ma_device_type_playback) {
-    auto output_count = frame_count * device->playback.channels;
-    auto *output_begin = reinterpret_cast<float *>(output);
-    auto output_end = output_begin + output_count;
-    std::vector<float> samples(output_count);
-
-    for (const auto &[media_id, decoder] : state->decoders) {
-      odin_decoder_pop(decoder.ptr.get(), samples.data(), output_count,
-                       nullptr);
-      std::transform(output_begin, output_end, samples.data(), output_begin,
-                     std::plus<>());
-    }
-
-    if (state->encoder.has_value() &&
-        global::apm_effect_config.echo_canceller) {
-      odin_pipeline_update_apm_playback(
-          odin_encoder_get_pipeline(state->encoder->ptr.get()),
-          state->encoder->apm_effect_id, output_begin, output_count, 10);
-    }
+    state->process_playback(reinterpret_cast<float *>(output),
+                            frame_count * device->playback.channels);
   }
 }
 
 /**
- * Constructs a local state object and enumerates available audio devices.
+ * Enumerates available audio devices and stores them in the global device
+ * lists.
  */
-State::State() : room(nullptr, &odin_room_free), cipher(nullptr) {
+void enumerate_audio_devices() {
   ma_context context;
   ma_device_info *playback_devices = nullptr;
   ma_uint32 playback_devices_count = 0;
@@ -337,6 +732,277 @@ State::State() : room(nullptr, &odin_room_free), cipher(nullptr) {
   }
 }
 
+/**
+ * Constructs a local state object. RPCs that do not fit into the queue spill
+ * over into a locked list, so its capacity should cover the bursts the room
+ * is expected to emit between two polls.
+ */
+State::State(std::size_t rpc_queue_capacity)
+    : room(nullptr, &odin_room_free), cipher(nullptr),
+      metered_cipher(nullptr), loopback(nullptr),
+      loopback_peer_id(0), playback_format{48000, 2}, capture_format{48000, 1},
+      pipeline_config(
+          PipelineConfig{global::apm_effect_config, global::vad_effect_config}),
+      echo_canceller(global::apm_effect_config.echo_canceller),
+      datagrams(ODIN_DATAGRAM_QUEUE_CAPACITY),
+      datagram_batch(datagrams.capacity()),
+      datagram_sorted(datagrams.capacity()),
+      datagram_order(datagrams.capacity()), rpcs(rpc_queue_capacity),
+      rpcs_polled(0), rpcs_spilling(false), rpcs_spilled(0),
+      rpcs_spill_offset(0), capture_blocks_queued(0),
+      encoder_worker_running(false),
+      datagrams_sent(0), datagrams_received(0), datagram_bytes_sent(0),
+      datagram_bytes_received(0), rpc_bytes_sent(0), rpc_bytes_received(0),
+      left(false), stats_interval(0), cull_radius(0.0f) {}
+
+State::~State() { this->stop_encoder_worker(); }
+
+/**
+ * Hands captured samples to the encoder. With an encoder worker running, the
+ * samples are only copied into the capture queue, which keeps the cost in
+ * the capture callback down to a memcpy; otherwise they are processed right
+ * away.
+ */
+void State::submit_capture(const float *samples, uint32_t samples_count) {
+  if (!this->capture_blocks) {
+    this->process_capture(samples, samples_count);
+    return;
+  }
+
+  for (uint32_t offset = 0; offset < samples_count;
+       offset += ODIN_CAPTURE_BLOCK_SIZE) {
+    auto count = std::min<uint32_t>(samples_count - offset,
+                                    ODIN_CAPTURE_BLOCK_SIZE);
+    this->capture_blocks->push([&](CaptureBlock &block) {
+      block.samples_count = count;
+      std::copy_n(samples + offset, count, block.samples);
+    });
+  }
+  this->capture_blocks_queued.fetch_add(1, std::memory_order_release);
+  this->capture_blocks_queued.notify_one();
+}
+
+/**
+ * Starts a worker thread which drains the capture queue filled by
+ * `submit_capture`, runs the encoder and sends the resulting datagrams. The
+ * worker sleeps on an atomic counter whenever the queue is empty.
+ */
+void State::start_encoder_worker() {
+  this->capture_blocks = std::make_unique<queue::SpscRing<CaptureBlock>>(
+      ODIN_CAPTURE_QUEUE_CAPACITY);
+  this->encoder_worker_running = true;
+  this->encoder_worker = std::thread([this] {
+    std::vector<CaptureBlock *> blocks(this->capture_blocks->capacity());
+    while (this->encoder_worker_running) {
+      auto queued =
+          this->capture_blocks_queued.load(std::memory_order_acquire);
+      auto count = this->capture_blocks->acquire(blocks.data(), blocks.size());
+      for (std::size_t i = 0; i < count; ++i) {
+        this->process_capture(blocks[i]->samples, blocks[i]->samples_count);
+      }
+      this->capture_blocks->release(count);
+      if (count == 0) {
+        this->capture_blocks_queued.wait(queued, std::memory_order_acquire);
+      }
+    }
+  });
+}
+
+/**
+ * Stops the encoder worker, if any. Samples still queued are discarded.
+ */
+void State::stop_encoder_worker() {
+  if (!this->encoder_worker.joinable()) {
+    return;
+  }
+  this->encoder_worker_running = false;
+  this->capture_blocks_queued.fetch_add(1, std::memory_order_release);
+  this->capture_blocks_queued.notify_one();
+  this->encoder_worker.join();
+}
+
+/**
+ * Moves decoding to a group of worker threads, which pop all decoders one
+ * period ahead of the playback callback. The group decodes blocks of up to
+ * `samples_count` samples, which should match the playback period; longer
+ * periods are mixed on the audio thread instead.
+ */
+void State::start_decoder_group(std::size_t threads_count,
+                                std::size_t samples_count) {
+  this->decoder_group = std::make_unique<decoding::DecoderGroup>(
+      threads_count, ODIN_DECODER_GROUP_CAPACITY, samples_count);
+}
+
+/**
+ * Stops the decoder group, if any, and releases the decoders of its last
+ * batch. Must only be called while playback is stopped.
+ */
+void State::stop_decoder_group() {
+  this->decoder_group.reset();
+  this->decoded.reset();
+}
+
+/**
+ * Applies new settings to the built-in effects of the capture pipeline. This
+ * is only ever called on the capture thread right before pushing samples, so
+ * configuration changes never contend with `odin_encoder_push`.
+ */
+void State::apply_pipeline_config(Encoder &encoder,
+                                  const PipelineConfig &config) {
+  const OdinPipeline *pipeline = odin_encoder_get_pipeline(encoder.ptr.get());
+  if (encoder.apm_effect_id) {
+    odin_pipeline_set_apm_config(pipeline, encoder.apm_effect_id, &config.apm);
+  }
+  if (encoder.vad_effect_id) {
+    odin_pipeline_set_vad_config(pipeline, encoder.vad_effect_id, &config.vad);
+  }
+  this->echo_canceller.store(config.apm.echo_canceller,
+                             std::memory_order_relaxed);
+}
+
+/**
+ * Feeds captured samples into the encoder and sends all resulting datagrams
+ * to the room. Pending pipeline configuration changes are picked up first.
+ */
+void State::process_capture(const float *samples, uint32_t samples_count) {
+  auto current = this->encoder.read();
+  if (!*current) {
+    return;
+  }
+  auto &encoder = **current;
+
+  PipelineConfig config;
+  if (this->pipeline_config.try_take(config, encoder.config_generation)) {
+    this->apply_pipeline_config(encoder, config);
+  }
+
+  odin_encoder_push(encoder.ptr.get(), samples, samples_count);
+  for (;;) {
+    uint8_t datagram[ODIN_MAX_DATAGRAM_SIZE];
+    uint32_t datagram_length = sizeof(datagram);
+    switch (
+        odin_encoder_pop(encoder.ptr.get(), datagram, &datagram_length)) {
+    case ODIN_ERROR_SUCCESS:
+      if (this->loopback) {
+        this->loopback->send_datagram(this->loopback_peer_id, datagram,
+                                      datagram_length);
+      } else {
+        CHECK(odin_room_send_datagram(this->room.get(), datagram,
+                                      datagram_length));
+      }
+      this->datagrams_sent.fetch_add(1, std::memory_order_relaxed);
+      this->datagram_bytes_sent.fetch_add(datagram_length,
+                                          std::memory_order_relaxed);
+      break;
+    case ODIN_ERROR_NO_DATA:
+      return;
+    default:
+      LOG_ERROR("failed to encode audio datagram to send");
+      return;
+    };
+  }
+}
+
+/**
+ * Mixes the blocks the decoder group popped during the last period into the
+ * given playback buffer. Decoders beyond the capacity of the group are popped
+ * right here instead. If the period size changed since the batch was started,
+ * its blocks are dropped as silence rather than popping the same decoders a
+ * second time.
+ */
+template <typename OnPop, typename Pop>
+void State::mix_decoded(float *samples, uint32_t samples_count, OnPop &&on_pop,
+                        Pop &&pop) {
+  if (!this->decoded) {
+    std::fill_n(samples, samples_count, 0.0f);
+    return;
+  }
+  auto &group = *this->decoder_group;
+  group.finish();
+  std::size_t index = 0;
+  this->mixer.mix(
+      *this->decoded, samples, samples_count, on_pop,
+      [&](const auto &decoder, float *target, uint32_t count,
+          bool &is_silent) -> const float * {
+        auto i = index++;
+        if (i >= group.size()) {
+          return pop(decoder, target, count, is_silent);
+        }
+        if (group.block_size() != count) {
+          is_silent = true;
+          return target;
+        }
+        return group.get_samples(i, is_silent);
+      });
+}
+
+/**
+ * Routes queued datagrams to their decoders, mixes all decoders into the
+ * given playback buffer and forwards the result to the echo canceller. With
+ * a decoder group, the mix consists of the blocks decoded in the background
+ * during the last period, and the next batch is started on the way out; this
+ * adds one period of latency. The batch holds a reference to the snapshot it
+ * was started from, so the registry stays free to change in the meantime;
+ * dropping it is only ever an atomic decrement, as replaced snapshots are
+ * freed by the registry on its writing thread. Periods longer than the blocks
+ * of the group are mixed right away.
+ */
+void State::process_playback(float *samples, uint32_t samples_count) {
+  auto decoders = this->decoders.read();
+  auto now = playout::Clock::now();
+  auto on_pop = [&](const auto &decoder, bool is_silent) {
+    if (!is_idle(*decoder)) {
+      decoder->playout->record_pop(now, is_silent);
+    }
+  };
+  auto pop = [](const auto &decoder, float *target, uint32_t count,
+                bool &is_silent) -> const float * {
+    if (is_idle(*decoder)) {
+      is_silent = true;
+      return target;
+    }
+    return mixer::detail::Pop()(decoder, target, count, is_silent);
+  };
+
+  const bool decode_ahead =
+      this->decoder_group &&
+      samples_count <= this->decoder_group->max_block_size();
+  if (decode_ahead) {
+    this->mix_decoded(samples, samples_count, on_pop, pop);
+  } else if (this->decoder_group) {
+    // a batch still in flight must not pop decoders alongside the mixer
+    this->decoder_group->finish();
+    this->decoded.reset();
+  }
+
+  this->route_datagrams(*decoders);
+  for (const auto &[peer_id, decoder] : *decoders) {
+    decoder->playout->flush(now, [&](const uint8_t *bytes, uint32_t length) {
+      if (is_fed(*decoder)) {
+        odin_decoder_push(decoder->ptr.get(), bytes, length);
+      }
+    });
+  }
+
+  if (decode_ahead) {
+    this->decoded = decoders.share();
+    this->decoder_group->start(
+        *this->decoded, samples_count,
+        [](const auto &decoder) { return is_idle(*decoder); });
+  } else {
+    this->mixer.mix(*decoders, samples, samples_count, on_pop, pop);
+  }
+
+  if (this->echo_canceller.load(std::memory_order_relaxed)) {
+    auto encoder = this->encoder.read();
+    if (*encoder) {
+      odin_pipeline_update_apm_playback(
+          odin_encoder_get_pipeline((*encoder)->ptr.get()),
+          (*encoder)->apm_effect_id, samples, samples_count, 10);
+    }
+  }
+}
+
 /**
  * Handles room connection state changes and clears all encoders/decoders on
  * room leave.
@@ -345,7 +1011,7 @@ void State::on_room_status_changed(const std::string &status) {
   if (status == "joined")
     return;
 
-  this->encoder.reset();
+  this->encoder.update([](auto &encoder) { encoder.reset(); });
   this->decoders.clear();
 }
 
@@ -363,11 +1029,12 @@ void State::on_room_joined(const std::string &room_id,
 }
 
 /**
- * Closes the application when a room connection was closed by the server.
+ * Flags the state as left when a room connection was closed by the server,
+ * which makes the application shut down.
  */
 void State::on_room_left(const std::string &reason) {
   LOG_INFO("room left; {}", reason);
-  exit(EXIT_SUCCESS);
+  this->left = true;
 }
 
 /**
@@ -378,8 +1045,8 @@ void State::on_peer_joined(const api::PeerId peer_id,
                            const std::string &user_id) {
   LOG_INFO("peer {} joined with user id '{}'", peer_id, user_id);
 
-  if (ODIN_CRYPTO_PEER_STATUS_PASSWORD_MISSMATCH ==
-      odin_crypto_get_peer_status(this->cipher, peer_id)) {
+  if (this->cipher && ODIN_CRYPTO_PEER_STATUS_PASSWORD_MISSMATCH ==
+                          odin_crypto_get_peer_status(this->cipher, peer_id)) {
     LOG_WARNING(
         "unable to communicate with peer {}; master passwords doe not match",
         peer_id);
@@ -394,29 +1061,55 @@ void State::on_peer_joined(const api::PeerId peer_id,
  */
 void State::on_peer_left(const api::PeerId peer_id) {
   LOG_INFO("peer {} left", peer_id);
+  {
+    auto decoders = this->decoders.read();
+    if (auto decoder = DecoderRegistry::find(*decoders, peer_id)) {
+      log_playout_stats(fmt::format("peer {} playout", peer_id),
+                        decoder->playout->get_stats());
+    }
+  }
 
-  this->decoders.erase(peer_id);
+  this->decoders.detach(peer_id);
+  this->datagram_filter.remove(peer_id);
 }
 
 /**
  * Creates and configures an audio encoder for a specific peer. It retrieves
  * the encoder's processing pipeline and inserts built-in effects for speech
  * detection (VAD) and advanced audio processing (APM) as well as a custom
- * effect to track talk status for the local peer.
+ * effect to track talk status for the local peer. With a local position, the
+ * encoder also sends it twice per second while we are silent. An existing
+ * encoder is replaced once the audio threads no longer use it.
  */
 void State::configure_encoder(const api::PeerId peer_id) {
   OdinEncoder *encoder;
-  CHECK(odin_encoder_create(peer_id, this->capture_device.sampleRate,
-                            this->capture_device.capture.channels == 2,
-                            &encoder));
+  if (this->encoder_settings.has_value() || this->position.has_value()) {
+    // while we are silent, others only learn about our position from
+    // background updates
+    const auto settings = this->encoder_settings.value_or(congestion::Settings{
+        static_cast<uint32_t>(get_argument<int>("encoder-bitrate")),
+        static_cast<uint32_t>(get_argument<int>("encoder-packet-loss"))});
+    CHECK(odin_encoder_create_ex(
+        peer_id, this->capture_format.sample_rate,
+        this->capture_format.channels == 2, true, settings.bitrate_kbps,
+        settings.packet_loss_perc,
+        this->position.has_value() ? ODIN_POSITION_UPDATE_INTERVAL_MS : 0,
+        &encoder));
+  } else {
+    CHECK(odin_encoder_create(peer_id, this->capture_format.sample_rate,
+                              this->capture_format.channels == 2, &encoder));
+  }
   const OdinPipeline *pipeline = odin_encoder_get_pipeline(encoder);
+  if (this->position.has_value()) {
+    CHECK(odin_encoder_set_position(encoder, 1, &*this->position));
+  }
 
   uint32_t apm_effect_id;
   if (!has_argument("disable-apm")) {
     CHECK(odin_pipeline_insert_apm_effect(
         pipeline, odin_pipeline_get_effect_count(pipeline),
-        this->playback_device.sampleRate,
-        this->playback_device.playback.channels == 2, &apm_effect_id));
+        this->playback_format.sample_rate,
+        this->playback_format.channels == 2, &apm_effect_id));
     CHECK(odin_pipeline_set_apm_config(pipeline, apm_effect_id,
                                        &global::apm_effect_config));
   } else {
@@ -433,16 +1126,22 @@ void State::configure_encoder(const api::PeerId peer_id) {
     vad_effect_id = 0;
   }
 
-  this->encoder.emplace(
-      Encoder{OpaquePtr<OdinEncoder>(encoder, &odin_encoder_free),
+  auto e = std::make_shared<Encoder>(
+      Encoder{nullptr,
+              OpaquePtr<OdinEncoder>(encoder, &odin_encoder_free),
               vad_effect_id,
               apm_effect_id,
               {peer_id, true}});
 
   odin_pipeline_insert_custom_effect(
       pipeline, odin_pipeline_get_effect_count(pipeline),
-      custom_effect_talk_status, static_cast<const void *>(&this->encoder->ctx),
-      nullptr);
+      custom_effect_talk_status, static_cast<const void *>(&e->ctx), nullptr);
+
+  if (has_argument("profile-effects")) {
+    e->profiler = std::make_unique<profiler::PipelineProfiler>(pipeline);
+  }
+
+  this->encoder.update([&](auto &current) { current = std::move(e); });
 }
 
 /**
@@ -452,72 +1151,473 @@ void State::configure_encoder(const api::PeerId peer_id) {
  */
 void State::configure_decoder(const api::PeerId peer_id) {
   OdinDecoder *decoder;
-  CHECK(odin_decoder_create(this->playback_device.sampleRate,
-                            this->playback_device.playback.channels == 2,
-                            &decoder));
+  CHECK(odin_decoder_create(this->playback_format.sample_rate,
+                            this->playback_format.channels == 2, &decoder));
   const OdinPipeline *pipeline = odin_decoder_get_pipeline(decoder);
 
-  auto [d, inserted] = this->decoders.insert(
-      {peer_id, Decoder{OpaquePtr<OdinDecoder>(decoder, &odin_decoder_free),
-                        {peer_id, true}}});
-  assert(inserted);
+  auto d = std::make_shared<Decoder>(
+      Decoder{OpaquePtr<OdinDecoder>(decoder, &odin_decoder_free),
+              {peer_id, true}});
+  d->playout = std::make_unique<playout::Buffer>(
+      playout::Config{
+          std::chrono::milliseconds(get_argument<int>("playout-delay")),
+          std::chrono::milliseconds(get_argument<int>("playout-min-delay")),
+          std::chrono::milliseconds(get_argument<int>("playout-max-delay"))},
+      ODIN_MAX_DATAGRAM_SIZE);
+  if (this->cull_radius > 0.0f) {
+    d->spatial = std::make_unique<spatial::PeerState>();
+  }
+  if (this->speaker_selector.has_value()) {
+    d->speaker = std::make_unique<selection::Speaker>();
+  }
 
   odin_pipeline_insert_custom_effect(pipeline, 0, custom_effect_talk_status,
-                                     static_cast<const void *>(&d->second.ctx),
+                                     static_cast<const void *>(&d->ctx),
                                      nullptr);
+
+  this->decoders.attach(peer_id, std::move(d));
 }
 
 /**
- * Sends a remote procedure call (RPC) command to the server. It serializes
- * the given command object to JSON, converts it to MessagePack format and
- * transmits it.
+ * Samples the round-trip time of the room connection and the loss observed on
+ * incoming audio about once per second and feeds them to the bitrate
+ * controller. The loss of the peers' streams stands in for the loss on our
+ * own uplink, which is not reported back to us. As the codec settings of an
+ * ODIN encoder are fixed, the encoder is recreated whenever the controller
+ * settles on new ones, which also resets its echo canceller; the controller
+ * holds back small and frequent changes to keep that rare.
  */
-void State::send_rpc(api::client::Command cmd) {
-  nlohmann::json rpc = cmd;
-  LOG_DEBUG("sending rpc: {}", rpc.dump());
+void State::adapt_encoder(std::chrono::steady_clock::time_point now) {
+  if (!this->bitrate_controller.has_value() ||
+      now - this->bitrate_adapted < std::chrono::seconds(1)) {
+    return;
+  }
+  this->bitrate_adapted = now;
 
-  try {
-    CHECK(odin_room_send_rpc(this->room.get(), rpc.dump().data()));
-  } catch (const std::exception &e) {
-    LOG_WARNING("failed to encode outgoing rpc; {}", e.what());
+  api::PeerId peer_id;
+  {
+    auto encoder = this->encoder.read();
+    if (!*encoder) {
+      return;
+    }
+    peer_id = static_cast<api::PeerId>((*encoder)->ctx.peer_id);
+  }
+
+  playout::Stats playout_stats;
+  {
+    auto decoders = this->decoders.read();
+    for (const auto &entry : *decoders) {
+      playout_stats += entry.second->playout->get_stats();
+    }
+  }
+  auto &previous = this->bitrate_playout_stats;
+  std::optional<double> loss_percent;
+  if (playout_stats.datagrams > previous.datagrams &&
+      playout_stats.lost >= previous.lost) {
+    playout::Stats interval;
+    interval.datagrams = playout_stats.datagrams - previous.datagrams;
+    interval.lost = playout_stats.lost - previous.lost;
+    loss_percent = interval.loss_percent();
+  }
+  previous = playout_stats;
+
+  OdinConnectionStats connection_stats{};
+  if (this->room) {
+    odin_room_get_connection_stats(this->room.get(), &connection_stats);
+  }
+
+  auto settings =
+      this->bitrate_controller->update(connection_stats.rtt, loss_percent);
+  if (settings.has_value()) {
+    LOG_INFO("recreating encoder at {} kbps with {}% expected packet loss "
+             "(rtt {:.0f} ms, loss {:.1f}%)",
+             settings->bitrate_kbps, settings->packet_loss_perc,
+             connection_stats.rtt, loss_percent.value_or(0.0));
+    this->encoder_settings = settings;
+    this->configure_encoder(peer_id);
   }
 }
 
 /**
- * Initializes and starts the audio playback and capture devices according
- * to the provided device indices, sample rates, and channel counts. It uses
- * the global device lists to look up the desired device IDs.
+ * Collects the extended connection statistics of the room. The round-trip
+ * time range covers the samples taken since statistics were last reported.
  */
-void State::start_audio_devices(int playback_device_idx,
-                                int playback_device_sample_rate_hz,
-                                int playback_device_channel_count,
-                                int capture_device_idx,
-                                int capture_device_sample_rate_hz,
-                                int capture_device_channels_count) {
-  if (global::playback_devices.size()) {
-    auto config = ma_device_config_init(ma_device_type_playback);
-    if (playback_device_idx > 0 &&
-        playback_device_idx < global::playback_devices.size()) {
-      config.playback.pDeviceID =
-          &global::playback_devices[playback_device_idx - 1].id;
+stats::RoomStats State::get_room_stats() {
+  constexpr auto relaxed = std::memory_order_relaxed;
+  stats::RoomStats stats;
+  if (this->room) {
+    odin_room_get_connection_stats(this->room.get(), &stats.connection);
+  }
+  stats.rtt_min_ms = this->rtt.min();
+  stats.rtt_mean_ms = this->rtt.mean();
+  stats.rtt_max_ms = this->rtt.max();
+  stats.datagram_tx_bytes = this->datagram_bytes_sent.load(relaxed);
+  stats.datagram_rx_bytes = this->datagram_bytes_received.load(relaxed);
+  stats.rpc_tx_bytes = this->rpc_bytes_sent.load(relaxed);
+  stats.rpc_rx_bytes = this->rpc_bytes_received.load(relaxed);
+
+  playout::Stats playout_stats;
+  {
+    auto decoders = this->decoders.read();
+    for (const auto &entry : *decoders) {
+      playout_stats += entry.second->playout->get_stats();
     }
-    config.playback.format = ma_format_f32;
-    config.playback.channels = std::clamp(playback_device_channel_count, 1, 2);
-    config.sampleRate = playback_device_sample_rate_hz;
-    config.dataCallback = handle_audio_data;
-    config.pUserData = this;
+  }
+  stats.loss_percent = playout_stats.loss_percent();
+  stats.jitter_ms = playout_stats.jitter_ms;
+  return stats;
+}
 
-    auto result = ma_device_init(nullptr, &config, &this->playback_device);
-    if ((result = ma_device_start(&this->playback_device)) != MA_SUCCESS) {
-      LOG_ERROR("failed to open audio playback device; {}",
-                ma_result_description(result));
-      ma_device_uninit(&this->playback_device);
-    } else {
-      LOG_INFO("using audio playback device: {}",
-               this->playback_device.playback.name);
+/**
+ * Collects the receive statistics of the given remote peer, if it is known.
+ */
+std::optional<stats::PeerStats>
+State::get_peer_stats(api::PeerId peer_id,
+                      std::chrono::steady_clock::time_point now) {
+  auto decoders = this->decoders.read();
+  auto decoder = DecoderRegistry::find(*decoders, peer_id);
+  if (!decoder) {
+    return std::nullopt;
+  }
+  stats::PeerStats stats{peer_id, decoder->playout->get_stats()};
+  if (stats.playout.datagrams) {
+    stats.last_datagram_age = now - stats.playout.last_received;
+  }
+  return stats;
+}
+
+/**
+ * Samples the round-trip time about once per second and, if enabled with
+ * `--stats-interval`, logs the room and per-peer statistics with rates
+ * computed over the reporting interval. Must be called on the thread
+ * handling room events.
+ */
+void State::update_stats(std::chrono::steady_clock::time_point now) {
+  if (this->room && now - this->rtt_sampled >= std::chrono::seconds(1)) {
+    OdinConnectionStats connection_stats;
+    if (odin_room_get_connection_stats(this->room.get(), &connection_stats) ==
+        ODIN_ERROR_SUCCESS) {
+      this->rtt.record(connection_stats.rtt);
     }
-  } else {
-    LOG_WARNING("no audio capture device available");
+    this->rtt_sampled = now;
+  }
+
+  if (this->stats_interval.count() == 0) {
+    return;
+  }
+  if (this->stats_logged == std::chrono::steady_clock::time_point{}) {
+    this->stats_logged = now;
+    return;
+  }
+  const auto elapsed = now - this->stats_logged;
+  if (elapsed < this->stats_interval) {
+    return;
+  }
+  this->stats_logged = now;
+
+  const auto room_stats = this->get_room_stats();
+  const auto &previous = this->room_stats_logged;
+  LOG_INFO("connection: rtt {:.0f}/{:.0f}/{:.0f} ms (min/mean/max), udp {:.1f} "
+           "kbps out/{:.1f} kbps in; datagrams {:.1f}/{:.1f} kbps, rpcs "
+           "{:.1f}/{:.1f} kbps, overhead {:.1f}/{:.1f} kbps; loss {:.1f}%, "
+           "max jitter {:.1f} ms",
+           room_stats.rtt_min_ms, room_stats.rtt_mean_ms,
+           room_stats.rtt_max_ms,
+           stats::kbps(room_stats.connection.udp_tx_bytes,
+                       previous.connection.udp_tx_bytes, elapsed),
+           stats::kbps(room_stats.connection.udp_rx_bytes,
+                       previous.connection.udp_rx_bytes, elapsed),
+           stats::kbps(room_stats.datagram_tx_bytes,
+                       previous.datagram_tx_bytes, elapsed),
+           stats::kbps(room_stats.datagram_rx_bytes,
+                       previous.datagram_rx_bytes, elapsed),
+           stats::kbps(room_stats.rpc_tx_bytes, previous.rpc_tx_bytes,
+                       elapsed),
+           stats::kbps(room_stats.rpc_rx_bytes, previous.rpc_rx_bytes,
+                       elapsed),
+           stats::kbps(room_stats.overhead_tx_bytes(),
+                       previous.overhead_tx_bytes(), elapsed),
+           stats::kbps(room_stats.overhead_rx_bytes(),
+                       previous.overhead_rx_bytes(), elapsed),
+           room_stats.loss_percent, room_stats.jitter_ms);
+  this->room_stats_logged = room_stats;
+  this->rtt.reset();
+
+  if (this->metered_cipher) {
+    const auto cipher_stats = this->metered_cipher->get_stats();
+    const auto &before = this->cipher_stats_logged;
+    LOG_INFO("cipher: {} datagrams decrypted, {} rejected, mean {:.2f} us, "
+             "peak {:.1f} us; {} key events",
+             cipher_stats.datagrams_decrypted - before.datagrams_decrypted,
+             cipher_stats.datagrams_rejected - before.datagrams_rejected,
+             cipher_stats.mean_decrypt_us(before),
+             cipher_stats.decrypt_max_ns / 1000.0,
+             cipher_stats.events - before.events);
+    this->cipher_stats_logged = cipher_stats;
+  }
+
+  std::vector<api::PeerId> peer_ids;
+  {
+    auto decoders = this->decoders.read();
+    for (const auto &entry : *decoders) {
+      peer_ids.push_back(entry.first);
+    }
+  }
+  std::unordered_map<api::PeerId, playout::Stats> peer_stats_logged;
+  for (auto peer_id : peer_ids) {
+    auto peer_stats = this->get_peer_stats(peer_id, now);
+    if (!peer_stats.has_value()) {
+      continue;
+    }
+    const auto &playout = peer_stats->playout;
+    auto before = this->peer_stats_logged[peer_id];
+    if (playout.datagrams < before.datagrams) {
+      before = playout::Stats();
+    }
+    const auto seconds = std::chrono::duration<double>(elapsed).count();
+    std::string last_datagram = "never";
+    if (peer_stats->last_datagram_age.has_value()) {
+      last_datagram = fmt::format(
+          "{} ms ago", std::chrono::duration_cast<std::chrono::milliseconds>(
+                           *peer_stats->last_datagram_age)
+                           .count());
+    }
+    LOG_INFO("peer {}: {:.1f} kbps, {:.1f} datagrams/s, loss {:.1f}%, jitter "
+             "{:.1f} ms, last datagram {}",
+             peer_id, stats::kbps(playout.bytes, before.bytes, elapsed),
+             (playout.datagrams - before.datagrams) / seconds,
+             playout.loss_percent(), playout.jitter_ms, last_datagram);
+    peer_stats_logged.emplace(peer_id, playout);
+  }
+  this->peer_stats_logged = std::move(peer_stats_logged);
+}
+
+/**
+ * Decides about four times per second which remote peers are in range of the
+ * local position, if enabled with `--cull-radius`. With only our own
+ * position to test against, a single pass comparing squared distances is all
+ * it takes. Peers that have not sent a position yet are always heard. A peer
+ * is culled once it is farther away than the radius plus a tenth and only
+ * heard again once it is back within the radius, so peers right at the edge
+ * do not flap. Culled peers keep feeding their decoders, which is how we
+ * learn about their movement, so a peer coming back gets a fresh decoder
+ * instead of the stale audio piled up in the old one. Must be called on the
+ * thread handling room events.
+ */
+void State::cull_peers(std::chrono::steady_clock::time_point now) {
+  if (this->cull_radius <= 0.0f ||
+      now - this->culled < std::chrono::milliseconds(250)) {
+    return;
+  }
+  this->culled = now;
+
+  const auto &center = *this->position;
+  const float enter_squared = this->cull_radius * this->cull_radius;
+  const float leave_squared = enter_squared * 1.1f * 1.1f;
+  std::vector<api::PeerId> returning;
+  {
+    auto decoders = this->decoders.read();
+    for (const auto &[peer_id, decoder] : *decoders) {
+      auto position = decoder->spatial->load_position();
+      if (!position.has_value()) {
+        continue;
+      }
+      const float distance_squared =
+          spatial::distance_squared(*position, center);
+      if (!decoder->spatial->is_culled() && distance_squared > leave_squared) {
+        decoder->spatial->set_culled(true);
+        LOG_DEBUG("culled peer {} at distance {:.1f}", peer_id,
+                  std::sqrt(distance_squared));
+      } else if (decoder->spatial->is_culled() &&
+                 distance_squared <= enter_squared) {
+        returning.push_back(peer_id);
+      }
+    }
+  }
+  for (auto peer_id : returning) {
+    LOG_DEBUG("peer {} is back in range", peer_id);
+    this->configure_decoder(peer_id);
+  }
+}
+
+/**
+ * Drains all datagrams queued by the network thread in a single batch and
+ * routes them to their decoders. The batch is grouped by peer, so each peer
+ * costs one decoder lookup regardless of how many of its packets arrived
+ * since the last audio period. Running this on the audio thread also means
+ * that decoder pushes and pops never contend with each other. If only the
+ * loudest peers are to be heard, the selection is updated from the batch
+ * before any of it is pushed, so a peer that just started talking is heard
+ * from its first datagrams on.
+ */
+void State::route_datagrams(const DecoderRegistry::Entries &decoders) {
+  auto &batch = this->datagram_batch;
+  auto count = this->datagrams.acquire(batch.data(), batch.size());
+  if (count == 0) {
+    this->select_speakers(decoders);
+    return;
+  }
+
+  // sort by peer while keeping arrival order within each peer; `std::sort`
+  // works in place, unlike `std::stable_sort` which may allocate
+  auto &order = this->datagram_order;
+  for (std::size_t i = 0; i < count; ++i) {
+    order[i] = (uint64_t{batch[i]->properties.peer_id} << 32) | i;
+  }
+  std::sort(order.begin(), order.begin() + count);
+  for (std::size_t i = 0; i < count; ++i) {
+    this->datagram_sorted[i] = batch[order[i] & 0xffffffff];
+  }
+
+  auto &sorted = this->datagram_sorted;
+  auto for_each_peer = [&](auto &&fn) {
+    for (std::size_t begin = 0, end = 0; begin < count; begin = end) {
+      auto peer_id = sorted[begin]->properties.peer_id;
+      while (end < count && sorted[end]->properties.peer_id == peer_id) {
+        ++end;
+      }
+      if (auto decoder = DecoderRegistry::find(decoders, peer_id)) {
+        fn(*decoder, &sorted[begin], end - begin);
+      }
+    }
+  };
+
+  if (this->speaker_selector) {
+    for_each_peer([](Decoder &decoder, Datagram *const *datagrams,
+                     std::size_t datagrams_count) {
+      if (decoder.speaker && !is_culled(decoder)) {
+        for (std::size_t i = 0; i < datagrams_count; ++i) {
+          decoder.speaker->add_bytes(datagrams[i]->length);
+        }
+      }
+    });
+    this->select_speakers(decoders);
+  }
+  for_each_peer(push_datagrams);
+
+  this->datagrams.release(count);
+}
+
+/**
+ * Updates which peers are among the loudest speakers, if enabled with
+ * `--max-speakers`. Peers out of range do not compete for a slot. Must be
+ * called on the audio thread once per period.
+ */
+void State::select_speakers(const DecoderRegistry::Entries &decoders) {
+  if (!this->speaker_selector) {
+    return;
+  }
+  this->speaker_selector->update(
+      decoders, [](const auto &entry) -> selection::Speaker * {
+        return is_culled(*entry.second) ? nullptr : entry.second->speaker.get();
+      });
+}
+
+/**
+ * Retrieves up to `max_count` queued RPCs in the order they were received.
+ * The returned pointers are views into the queue or the spill list and stay
+ * valid until the next call, which hands the previous batch back to the
+ * network thread. While RPCs are spilling over, the network thread stops
+ * using the queue, so once it is drained, the spill list holds everything
+ * that follows.
+ */
+std::size_t State::poll_rpcs(Rpc **out_rpcs, std::size_t max_count) {
+  this->rpcs.release(this->rpcs_polled);
+  this->rpcs_polled = 0;
+
+  auto &spilled = this->rpcs_spill_polled;
+  if (this->rpcs_spill_offset == spilled.size()) {
+    this->rpcs_polled = this->rpcs.acquire(out_rpcs, max_count);
+    if (this->rpcs_polled > 0 ||
+        !this->rpcs_spilling.load(std::memory_order_acquire)) {
+      return this->rpcs_polled;
+    }
+    spilled.clear();
+    this->rpcs_spill_offset = 0;
+    std::lock_guard lock(this->rpcs_spill_mutex);
+    std::swap(this->rpcs_spill, spilled);
+    this->rpcs_spilling.store(false, std::memory_order_relaxed);
+  }
+
+  auto count = std::min(max_count, spilled.size() - this->rpcs_spill_offset);
+  for (std::size_t i = 0; i < count; ++i) {
+    out_rpcs[i] = &spilled[this->rpcs_spill_offset + i];
+  }
+  this->rpcs_spill_offset += count;
+  return count;
+}
+
+/**
+ * Sends a remote procedure call (RPC) command to the server. It serializes
+ * the given command object to JSON, converts it to MessagePack format and
+ * transmits it.
+ */
+void State::send_rpc(api::client::Command cmd) {
+  nlohmann::json rpc = cmd;
+  LOG_DEBUG("sending rpc: {}", rpc.dump());
+
+  try {
+    auto text = rpc.dump();
+    if (this->loopback) {
+      this->loopback->send_rpc(this->loopback_peer_id, text);
+    } else {
+      CHECK(odin_room_send_rpc(this->room.get(), text.data()));
+    }
+    this->rpc_bytes_sent.fetch_add(text.size(), std::memory_order_relaxed);
+  } catch (const std::exception &e) {
+    LOG_WARNING("failed to encode outgoing rpc; {}", e.what());
+  }
+}
+
+/**
+ * Initializes and starts the audio playback and capture devices according
+ * to the provided device indices, sample rates, and channel counts. It uses
+ * the global device lists to look up the desired device IDs.
+ */
+void State::start_audio_devices(int playback_device_idx,
+                                int playback_device_sample_rate_hz,
+                                int playback_device_channel_count,
+                                int capture_device_idx,
+                                int capture_device_sample_rate_hz,
+                                int capture_device_channels_count) {
+  this->playback_format = {
+      static_cast<uint32_t>(playback_device_sample_rate_hz),
+      static_cast<uint32_t>(std::clamp(playback_device_channel_count, 1, 2))};
+  this->capture_format = {
+      static_cast<uint32_t>(capture_device_sample_rate_hz),
+      static_cast<uint32_t>(std::clamp(capture_device_channels_count, 1, 2))};
+
+  if (global::playback_devices.size()) {
+    auto config = ma_device_config_init(ma_device_type_playback);
+    if (playback_device_idx > 0 &&
+        playback_device_idx < global::playback_devices.size()) {
+      config.playback.pDeviceID =
+          &global::playback_devices[playback_device_idx - 1].id;
+    }
+    config.playback.format = ma_format_f32;
+    config.playback.channels = std::clamp(playback_device_channel_count, 1, 2);
+    config.sampleRate = playback_device_sample_rate_hz;
+    config.dataCallback = handle_audio_data;
+    config.pUserData = this;
+    if (this->decoder_group) {
+      // callbacks of this size fit the blocks of the decoder group
+      config.periodSizeInFrames =
+          this->decoder_group->max_block_size() / config.playback.channels;
+    }
+
+    auto result = ma_device_init(nullptr, &config, &this->playback_device);
+    if ((result = ma_device_start(&this->playback_device)) != MA_SUCCESS) {
+      LOG_ERROR("failed to open audio playback device; {}",
+                ma_result_description(result));
+      ma_device_uninit(&this->playback_device);
+    } else {
+      LOG_INFO("using audio playback device: {}",
+               this->playback_device.playback.name);
+      this->playback_format = {this->playback_device.sampleRate,
+                               this->playback_device.playback.channels};
+    }
+  } else {
+    LOG_WARNING("no audio capture device available");
   }
 
   if (global::capture_devices.size()) {
@@ -541,6 +1641,8 @@ void State::start_audio_devices(int playback_device_idx,
     } else {
       LOG_INFO("using audio capture device: {}",
                this->capture_device.capture.name);
+      this->capture_format = {this->capture_device.sampleRate,
+                              this->capture_device.capture.channels};
     }
   } else {
     LOG_WARNING("no audio capture device available");
@@ -555,6 +1657,7 @@ void State::start_audio_devices(int playback_device_idx,
 void State::stop_audio_devices() {
   ma_device_uninit(&this->playback_device);
   ma_device_uninit(&this->capture_device);
+  this->stop_decoder_group();
 }
 
 /**
@@ -612,6 +1715,22 @@ OpaquePtr<OdinTokenGenerator> get_token_generator(std::string &access_key) {
   return {token_generator, &odin_token_generator_free};
 }
 
+/**
+ * Builds the claims shared by all tokens for the given room, which are the
+ * room ID and, when bypassing the gateway, the audience and server address.
+ */
+tokens::ClaimsTemplate make_claims_template(const std::string &room_id) {
+  nlohmann::json claims = {{"rid", room_id}};
+  if (has_argument("bypass-gateway")) {
+    claims.update({
+        {"adr", get_argument<std::string>("server-url")},
+        {"aud", "sfu"},
+        {"cid", "<no_customer>"},
+    });
+  }
+  return tokens::ClaimsTemplate(claims);
+}
+
 /**
  * Constructs a JSON payload with the audience, room ID, user ID and
  * validity timestamps, then signs it using the provided token generator to
@@ -623,56 +1742,105 @@ std::string generate_token(OpaquePtr<OdinTokenGenerator> &token_generator,
   auto nbf = time(nullptr);
   auto exp = nbf + 300; /* 5 minutes */
 
-  nlohmann::json claims = {
-      {"rid", room_id},
-      {"uid", user_id},
-      {"nbf", nbf},
-      {"exp", exp},
-  };
-
-  if (has_argument("bypass-gateway")) {
-    claims.update({
-        {"adr", get_argument<std::string>("server-url")},
-        {"aud", "sfu"},
-        {"cid", "<no_customer>"},
-    });
-  }
+  std::string claims;
+  make_claims_template(room_id).render(claims, user_id, nbf, exp);
 
   std::string token(1024, '\0');
   uint32_t token_length = token.size();
-  CHECK(odin_token_generator_sign(token_generator.get(), claims.dump().c_str(),
+  CHECK(odin_token_generator_sign(token_generator.get(), claims.c_str(),
                                   &token[0], &token_length));
   token.resize(token_length);
 
   return token;
 }
 
+/**
+ * Signs tokens for many users of the same room at once, spreading the work
+ * over up to one thread per 256 tokens.
+ */
+std::vector<std::string>
+generate_tokens(const std::string &access_key, const std::string &room_id,
+                const std::vector<std::string> &user_ids) {
+  auto nbf = time(nullptr);
+  auto exp = nbf + 300; /* 5 minutes */
+
+  auto threads_count = std::clamp<std::size_t>(
+      (user_ids.size() + 255) / 256, 1,
+      std::max(1u, std::thread::hardware_concurrency()));
+  auto signer = tokens::BatchSigner::create(access_key, threads_count);
+  if (!signer) {
+    LOG_CRITICAL("failed to create token generators: {}",
+                 odin_error_get_last_error());
+  }
+  std::vector<std::string> room_tokens;
+  CHECK(signer->sign(make_claims_template(room_id), user_ids, nbf, exp,
+                     room_tokens));
+  return room_tokens;
+}
+
 /**
  * Callback invoked when a voice datagram is received from the room. This
  * function is registered with the ODIN room to handle incoming audio data.
- * It verifies the room reference, looks up the decoder for the source peer
- * and pushes the datagram into it for decoding and playback.
+ * It verifies the room reference and queues the datagram, so the audio thread
+ * can push everything received since its last period into the decoders in
+ * one batch.
  */
 void on_datagram(OdinRoom *room, const OdinDatagramProperties *properties,
                  const uint8_t *bytes, uint32_t bytes_length, void *user_data) {
   const auto state = reinterpret_cast<State *>(user_data);
   assert(state->room.get() == room);
-  if (auto it = state->decoders.find(properties->peer_id);
-      it != state->decoders.end()) {
-    CHECK(odin_decoder_push(it->second.ptr.get(), bytes, bytes_length));
+  state->datagrams_received.fetch_add(1, std::memory_order_relaxed);
+  state->datagram_bytes_received.fetch_add(bytes_length,
+                                           std::memory_order_relaxed);
+  if (!state->datagram_filter.accept(*properties)) {
+    return;
+  }
+  if (bytes_length > ODIN_MAX_DATAGRAM_SIZE) {
+    LOG_WARNING("dropping oversized datagram from peer {}",
+                properties->peer_id);
+    return;
+  }
+  if (!state->datagrams.push([&](Datagram &datagram) {
+        datagram.properties = *properties;
+        datagram.received = playout::Clock::now();
+        datagram.length = bytes_length;
+        std::copy_n(bytes, bytes_length, datagram.bytes);
+      })) {
+    LOG_DEBUG("datagram queue full; dropped {} datagrams so far",
+              state->datagrams.overflow_count());
   }
 }
 
 /**
  * Callback invoked when an RPC message is received from the room. This
  * function is registered with the ODIN connection pool to handle incoming RPC
- * datagrams. It verifies the room reference, deserializes the MessagePack
- * payload into JSON, converts it to a server event variant and dispatches it
- * to the appropriate handler.
+ * datagrams. It verifies the room reference and queues the JSON text, so the
+ * event is handled on the application thread via `handle_rpc`. Events are
+ * never dropped; if the queue is full, they spill over into a list that is
+ * polled once the queue is drained, and so does everything after them until
+ * then to keep the order.
  */
 void on_rpc(OdinRoom *room, const char *text, void *user_data) {
   const auto state = reinterpret_cast<State *>(user_data);
   assert(state->room.get() == room);
+  state->rpc_bytes_received.fetch_add(std::strlen(text),
+                                      std::memory_order_relaxed);
+  if (!state->rpcs_spilling.load(std::memory_order_relaxed) &&
+      state->rpcs.push([text](Rpc &rpc) { rpc.json.assign(text); })) {
+    return;
+  }
+  std::lock_guard lock(state->rpcs_spill_mutex);
+  state->rpcs_spill.push_back(Rpc{text});
+  state->rpcs_spilling.store(true, std::memory_order_release);
+  state->rpcs_spilled.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Handles an RPC polled from the room. It deserializes the JSON payload,
+ * converts it to a server event variant and dispatches it to the appropriate
+ * handler.
+ */
+void handle_rpc(State *state, const std::string &text) {
   try {
     nlohmann::json rpc = nlohmann::json::parse(text);
     LOG_DEBUG("received rpc: {}", rpc.dump());
@@ -715,11 +1883,569 @@ void on_rpc(OdinRoom *room, const char *text, void *user_data) {
   }
 }
 
+/**
+ * Returns the channel masks to join a room with, limiting the channels we
+ * hear from individual peers.
+ */
+std::vector<std::pair<api::PeerId, api::ChannelMask>> initial_channel_masks() {
+  // only want to hear peer 1 on channels 1, 3 and 5 (000...00010101)
+  return {{1, 0x15}};
+}
+
+/**
+ * Builds the JSON authentication string used to join a room, which wraps the
+ * room token together with optional channel masks and peer user data.
+ */
+std::string build_authentication(const std::string &room_token,
+                                 const std::string &room_id) {
+  nlohmann::json authentication = nlohmann::json::object({
+      // mandatory room token
+      {"token", room_token},
+      // optional room id in caase the token contains multiple room ids
+      {"room_id", room_id},
+      // optional list of channel masks
+      {"channel_masks", initial_channel_masks()},
+      // optional peer user data
+      {"user_data", {{"foo", "bar"}, {"time", std::time(0)}}},
+  });
+  return authentication.dump();
+}
+
+/*
+ * Creates a new ODIN room pointer for the given state and establishes an
+ * encrypted connection to the ODIN network using the given cipher to join
+ * the specified room. If statistics are logged, the cipher is metered to
+ * report its per-datagram decryption cost.
+ */
+void create_room(State &state, const std::string &gateway,
+                 const std::string &authentication, OdinCipher *cipher) {
+  OdinRoom *room;
+  OdinRoomEvents events{
+      .on_datagram = &on_datagram,
+      .on_rpc = &on_rpc,
+      .user_data = reinterpret_cast<void *>(&state),
+  };
+  OdinCipher *attached = cipher;
+  if (cipher && state.stats_interval.count() > 0) {
+    state.metered_cipher = crypto::MeteredCipher::wrap(cipher);
+    attached = state.metered_cipher->get();
+  }
+  CHECK(odin_room_create(gateway.data(), authentication.data(), &events,
+                         attached, &room));
+  state.room = {room, odin_room_free};
+  state.cipher = cipher;
+}
+
+/**
+ * Creates an ODIN cipher for end-to-end-encryption and configures it if a
+ * master password was specified via command-line.
+ */
+OdinCipher *create_cipher() {
+  OdinCipher *cipher = odin_crypto_create(ODIN_CRYPTO_VERSION);
+  if (has_argument("password")) {
+    auto password = get_argument<std::string>("password");
+    LOG_INFO("configuring ODIN cipher with password '{}'", password);
+    auto started = std::chrono::steady_clock::now();
+    odin_crypto_set_password(cipher,
+                             reinterpret_cast<const uint8_t *>(password.data()),
+                             password.length());
+    LOG_DEBUG("derived master key in {} ms",
+              std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - started)
+                  .count());
+  }
+  return cipher;
+}
+
+/**
+ * Creates an ODIN cipher on a worker thread. Deriving the master key from a
+ * password runs PBKDF2 with a high iteration count, which blocks for long
+ * enough to be worth overlapping with opening the audio devices and fetching
+ * the room token instead of adding to the time it takes to join.
+ */
+std::future<OdinCipher *> create_cipher_async() {
+  return std::async(std::launch::async, create_cipher);
+}
+
+/**
+ * Creates a number of ODIN ciphers, e.g. one per simulated peer, on a pool of
+ * worker threads no larger than the number of hardware threads. Deriving keys
+ * is CPU-bound, so running more derivations at once would not finish any
+ * sooner and only starve every other thread of the process. Ciphers are
+ * created in order and can be waited for one by one.
+ */
+class CipherPool {
+public:
+  explicit CipherPool(std::size_t count) : promises(count) {
+    for (auto &promise : this->promises) {
+      this->ciphers.push_back(promise.get_future());
+    }
+    const auto threads_count = std::min<std::size_t>(
+        count, std::max(1u, std::thread::hardware_concurrency()));
+    for (std::size_t i = 0; i < threads_count; ++i) {
+      this->workers.emplace_back([this] { this->run(); });
+    }
+  }
+
+  CipherPool(const CipherPool &) = delete;
+  CipherPool &operator=(const CipherPool &) = delete;
+
+  ~CipherPool() {
+    for (auto &worker : this->workers) {
+      worker.join();
+    }
+  }
+
+  /**
+   * Waits for the cipher at the given index and returns it.
+   */
+  OdinCipher *get(std::size_t index) { return this->ciphers[index].get(); }
+
+private:
+  void run() {
+    for (auto i = this->next.fetch_add(1); i < this->promises.size();
+         i = this->next.fetch_add(1)) {
+      this->promises[i].set_value(create_cipher());
+    }
+  }
+
+  std::vector<std::promise<OdinCipher *>> promises;
+  std::vector<std::future<OdinCipher *>> ciphers;
+  std::atomic<std::size_t> next{0};
+  std::vector<std::thread> workers;
+};
+
+/**
+ * Applies the encoder options specified via command-line to the given state
+ * and sets up the bitrate controller if requested.
+ */
+void configure_encoder_settings(State &state) {
+  if (has_argument("encoder-bitrate") || has_argument("encoder-packet-loss") ||
+      has_argument("adaptive-bitrate")) {
+    state.encoder_settings = congestion::Settings{
+        static_cast<uint32_t>(get_argument<int>("encoder-bitrate")),
+        static_cast<uint32_t>(get_argument<int>("encoder-packet-loss"))};
+  }
+  if (has_argument("adaptive-bitrate")) {
+    congestion::Config config;
+    config.min_bitrate_kbps =
+        static_cast<uint32_t>(get_argument<int>("adaptive-min-bitrate"));
+    config.max_bitrate_kbps = state.encoder_settings->bitrate_kbps;
+    state.bitrate_controller.emplace(config, *state.encoder_settings);
+    state.encoder_settings = state.bitrate_controller->get_settings();
+  }
+}
+
+/**
+ * Applies the proximity options specified via command-line to the given
+ * state. Peers are only culled if both a position and a radius are given.
+ */
+void configure_proximity(State &state) {
+  if (has_argument("position")) {
+    OdinPosition position;
+    char separator[2];
+    std::istringstream stream(get_argument<std::string>("position"));
+    if (!(stream >> position.x >> separator[0] >> position.y >>
+          separator[1] >> position.z) ||
+        separator[0] != ',' || separator[1] != ',' || !stream.eof()) {
+      std::cerr << "Error: invalid position '"
+                << get_argument<std::string>("position") << "'" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    state.position = position;
+  }
+  if (state.position.has_value()) {
+    state.cull_radius = std::max(0.0f, get_argument<float>("cull-radius"));
+  }
+}
+
+/**
+ * Limits decoding to the loudest peers if requested via command-line.
+ */
+void configure_speaker_selection(State &state) {
+  if (get_argument<int>("max-speakers") > 0) {
+    state.speaker_selector.emplace(
+        selection::Config{
+            static_cast<std::size_t>(get_argument<int>("max-speakers"))},
+        ODIN_DECODER_GROUP_CAPACITY);
+  }
+}
+
+/**
+ * Updates the given audio processing settings from a command typed into the
+ * console. Returns `false` and prints the available commands if the line is
+ * not a valid command.
+ */
+bool parse_pipeline_command(const std::string &line, PipelineConfig &config) {
+  std::istringstream stream(line);
+  std::string name, value;
+  stream >> name >> value;
+
+  if (value == "on" || value == "off") {
+    const bool enabled = value == "on";
+    if (name == "aec") {
+      config.apm.echo_canceller = enabled;
+    } else if (name == "hpf") {
+      config.apm.high_pass_filter = enabled;
+    } else if (name == "ts") {
+      config.apm.transient_suppressor = enabled;
+    } else if (name == "vad") {
+      config.vad.voice_activity.enabled = enabled;
+    } else if (name == "gate") {
+      config.vad.volume_gate.enabled = enabled;
+    } else if (name == "agc" && !enabled) {
+      config.apm.gain_controller_version =
+          ODIN_GAIN_CONTROLLER_VERSION_DISABLED;
+    } else {
+      name.clear();
+    }
+  } else if (name == "ns" && value.size() == 1 && value[0] >= '0' &&
+             value[0] <= '4') {
+    config.apm.noise_suppression_level =
+        static_cast<OdinNoiseSuppressionLevel>(value[0] - '0');
+  } else if (name == "agc" && (value == "v1" || value == "v2")) {
+    config.apm.gain_controller_version = value == "v1"
+                                             ? ODIN_GAIN_CONTROLLER_VERSION_V1
+                                             : ODIN_GAIN_CONTROLLER_VERSION_V2;
+  } else {
+    name.clear();
+  }
+
+  if (name.empty()) {
+    std::cout << "Audio Processing Commands:" << std::endl
+              << "    aec|hpf|ts|vad|gate on|off" << std::endl
+              << "    ns 0-4" << std::endl
+              << "    agc off|v1|v2" << std::endl
+              << "Receive Commands:" << std::endl
+              << "    mute|unmute <peer id>" << std::endl;
+    return false;
+  }
+  LOG_INFO("changing audio processing: {} {}", name, value);
+  return true;
+}
+
+/**
+ * Mutes or unmutes a remote peer from a command typed into the console. The
+ * datagrams of muted peers are dropped as soon as they arrive, before they
+ * reach the decoder. Returns `false` if the line is not a receive command.
+ */
+bool parse_receive_command(const std::string &line,
+                           filter::DatagramFilter &datagram_filter) {
+  std::istringstream stream(line);
+  std::string name;
+  api::PeerId peer_id;
+  if (!(stream >> name >> peer_id) || (name != "mute" && name != "unmute")) {
+    return false;
+  }
+  if (name == "mute") {
+    datagram_filter.set(peer_id, 0);
+  } else {
+    datagram_filter.remove(peer_id);
+  }
+  LOG_INFO("{}d peer {}", name, peer_id);
+  return true;
+}
+
+/**
+ * Logs the time spent in each effect of a profiled pipeline, both per
+ * invocation and relative to the duration of the audio it processed.
+ */
+void log_effect_stats(const std::vector<profiler::EffectStats> &stats,
+                      const AudioFormat &format) {
+  for (std::size_t i = 0; i < stats.size(); ++i) {
+    const auto &effect = stats[i];
+    auto audio_ns = 1e9 * effect.samples / format.sample_rate / format.channels;
+    LOG_INFO("effect #{} ({}, id {}): {} calls, mean {:.1f} us, p99 < {:.0f} "
+             "us, max {:.1f} us, {:.2f}% of real time",
+             i, profiler::to_string(effect.effect_type), effect.effect_id,
+             effect.count, effect.mean_us(), effect.percentile_us(99),
+             effect.max_ns / 1000.0,
+             audio_ns > 0 ? 100.0 * effect.total_ns / audio_ns : 0.0);
+  }
+}
+
+/**
+ * A simulated peer in headless mode, which replaces the audio devices of its
+ * state with a capture source and a playback sink.
+ */
+struct Bot {
+  std::unique_ptr<State> state;
+  headless::Source source;
+  headless::Sink sink;
+  std::chrono::nanoseconds busy;
+};
+
+/**
+ * Runs the configured number of simulated peers without any audio devices.
+ * Every peer joins the room with its own state, encoder and decoders, while
+ * a single timer thread drives capture and playback for all of them in 20 ms
+ * ticks. When the run ends, a report with CPU usage per peer, datagram rates
+ * and tick latency percentiles is logged. With `--loopback`, all peers join
+ * an in-process room instead, which takes the server and network out of the
+ * measurements.
+ */
+void run_headless(const std::string &gateway, const std::string &room_id,
+                  const std::string &user_id,
+                  const std::function<std::vector<std::string>(
+                      const std::vector<std::string> &)> &get_room_tokens) {
+  using namespace std::chrono;
+  const auto period = milliseconds(20);
+  const auto bots_count = std::max(1, get_argument<int>("bots"));
+  // peers are set up before any rpcs are polled, and each of them is told
+  // about every other peer in the meantime
+  const auto rpc_queue_capacity =
+      static_cast<std::size_t>(ODIN_RPC_QUEUE_CAPACITY + bots_count);
+  const AudioFormat capture_format{
+      static_cast<uint32_t>(get_argument<int>("input-sample-rate")),
+      static_cast<uint32_t>(std::clamp(get_argument<int>("input-channels"), 1,
+                                       2))};
+  const AudioFormat playback_format{
+      static_cast<uint32_t>(get_argument<int>("output-sample-rate")),
+      static_cast<uint32_t>(
+          std::clamp(get_argument<int>("output-channels"), 1, 2))};
+  const auto capture_count =
+      capture_format.sample_rate / 50 * capture_format.channels;
+  const auto playback_count =
+      playback_format.sample_rate / 50 * playback_format.channels;
+
+  std::shared_ptr<const headless::Clip> clip;
+  if (has_argument("input-file")) {
+    auto path = get_argument<std::string>("input-file");
+    auto loaded = headless::load_clip(path, capture_format.sample_rate,
+                                      capture_format.channels);
+    if (!loaded.has_value()) {
+      LOG_CRITICAL("failed to load capture audio from '{}'", path);
+    }
+    clip = std::make_shared<const headless::Clip>(std::move(*loaded));
+  }
+
+  std::unique_ptr<loopback::Room> local_room;
+  if (has_argument("loopback")) {
+    local_room = std::make_unique<loopback::Room>(room_id);
+  }
+
+  std::vector<std::string> bot_user_ids;
+  for (int i = 0; i < bots_count; ++i) {
+    bot_user_ids.push_back(
+        bots_count > 1 ? fmt::format("{} #{}", user_id, i) : user_id);
+  }
+
+  // every peer needs a cipher of its own, so derive their keys on a pool of
+  // workers while the peers are set up; tokens are signed in a single batch
+  std::optional<CipherPool> ciphers;
+  std::vector<std::string> room_tokens;
+  if (!local_room) {
+    ciphers.emplace(bots_count);
+    room_tokens = get_room_tokens(bot_user_ids);
+  }
+
+  std::vector<Bot> bots;
+  bots.reserve(bots_count);
+  for (int i = 0; i < bots_count; ++i) {
+    auto state = std::make_unique<State>(rpc_queue_capacity);
+    state->capture_format = capture_format;
+    state->playback_format = playback_format;
+    state->mixer.limiter_threshold = get_argument<float>("limiter-threshold");
+    configure_encoder_settings(*state);
+    configure_proximity(*state);
+    configure_speaker_selection(*state);
+    state->stats_interval = seconds(get_argument<int>("stats-interval"));
+    if (has_argument("async-encoder")) {
+      state->start_encoder_worker();
+    }
+    if (get_argument<int>("decode-threads") > 0) {
+      state->start_decoder_group(get_argument<int>("decode-threads"),
+                                 playback_count);
+    }
+
+    auto source = clip ? headless::Source(clip, i * capture_count * 7)
+                       : headless::Source(220.0f + 20.0f * (i % 16),
+                                          capture_format.sample_rate,
+                                          capture_format.channels);
+    auto &bot = bots.emplace_back(
+        Bot{std::move(state), std::move(source), {}, nanoseconds(0)});
+
+    if (has_argument("output-file")) {
+      std::filesystem::path path = get_argument<std::string>("output-file");
+      if (bots_count > 1) {
+        path.replace_filename(path.stem().string() + "-" + std::to_string(i) +
+                              path.extension().string());
+      }
+      if (!bot.sink.open(path, playback_format.sample_rate,
+                         playback_format.channels)) {
+        LOG_WARNING("failed to open '{}' for writing", path.string());
+      }
+    }
+
+    if (local_room) {
+      bot.state->loopback = local_room.get();
+      bot.state->loopback_peer_id = local_room->join(
+          OdinRoomEvents{
+              .on_datagram = &on_datagram,
+              .on_rpc = &on_rpc,
+              .user_data = reinterpret_cast<void *>(bot.state.get()),
+          },
+          bot_user_ids[i], initial_channel_masks());
+    } else {
+      create_room(*bot.state, gateway,
+                  build_authentication(room_tokens[i], room_id),
+                  ciphers->get(i));
+    }
+  }
+  LOG_INFO("started {} simulated peers in room '{}'", bots_count, room_id);
+
+  std::atomic<bool> running = true;
+  const auto expected_ticks = static_cast<std::size_t>(
+      std::max(get_argument<int>("duration"), 60) * 1000 / period.count());
+  headless::Percentiles tick_durations(expected_ticks);
+  headless::Percentiles tick_lateness(expected_ticks);
+  uint64_t ticks = 0, overruns = 0;
+
+  const auto started = steady_clock::now();
+  const auto cpu_started = headless::process_cpu_time();
+  std::thread timer_thread([&] {
+    std::vector<float> capture(capture_count), playback(playback_count);
+    auto deadline = steady_clock::now();
+    while (running) {
+      deadline += period;
+      std::this_thread::sleep_until(deadline);
+      auto tick_started = steady_clock::now();
+      tick_lateness.record(tick_started - deadline);
+
+      for (auto &bot : bots) {
+        auto bot_started = steady_clock::now();
+        bot.source.read(capture.data(), capture.size());
+        bot.state->submit_capture(capture.data(), capture.size());
+        bot.state->process_playback(playback.data(), playback.size());
+        bot.sink.write(playback.data(), playback.size());
+        bot.busy += steady_clock::now() - bot_started;
+      }
+
+      auto tick_duration = steady_clock::now() - tick_started;
+      tick_durations.record(tick_duration);
+      overruns += tick_duration > period;
+      ++ticks;
+    }
+  });
+
+  std::optional<std::thread> input_thread;
+  const auto run_time = seconds(get_argument<int>("duration"));
+  if (run_time.count() == 0) {
+    std::cout << "--- Press RETURN to stop simulated peers and exit ---"
+              << std::endl;
+    input_thread.emplace([&running] {
+      getchar();
+      running = false;
+    });
+  }
+  std::vector<Rpc *> rpcs(rpc_queue_capacity);
+  while (running) {
+    for (auto &bot : bots) {
+      auto count = bot.state->poll_rpcs(rpcs.data(), rpcs.size());
+      for (std::size_t i = 0; i < count; ++i) {
+        handle_rpc(bot.state.get(), rpcs[i]->json);
+      }
+      bot.state->adapt_encoder(steady_clock::now());
+      bot.state->update_stats(steady_clock::now());
+      bot.state->cull_peers(steady_clock::now());
+      bot.state->decoders.collect();
+    }
+    if (run_time.count() && steady_clock::now() - started >= run_time) {
+      running = false;
+    }
+    std::this_thread::sleep_for(milliseconds(5));
+  }
+  timer_thread.join();
+  for (auto &bot : bots) {
+    bot.state->stop_encoder_worker();
+    bot.state->stop_decoder_group();
+  }
+  if (input_thread.has_value()) {
+    input_thread->join();
+  }
+
+  const auto elapsed = duration_cast<duration<double>>(steady_clock::now() -
+                                                       started)
+                           .count();
+  const auto cpu_seconds =
+      duration_cast<duration<double>>(headless::process_cpu_time() -
+                                      cpu_started)
+          .count();
+  uint64_t total_sent = 0, total_received = 0;
+  for (std::size_t i = 0; i < bots.size(); ++i) {
+    const auto &state = *bots[i].state;
+    auto sent = state.datagrams_sent.load();
+    auto received = state.datagrams_received.load();
+    total_sent += sent;
+    total_received += received;
+    LOG_INFO("peer {}: {:.2f}% cpu on timer thread, {:.1f} datagrams/s sent, "
+             "{:.1f} datagrams/s received, {} datagrams dropped, {} filtered",
+             i,
+             100.0 * duration_cast<duration<double>>(bots[i].busy).count() /
+                 elapsed,
+             sent / elapsed, received / elapsed,
+             state.datagrams.overflow_count(),
+             state.datagram_filter.dropped_count());
+  }
+  LOG_INFO("{} peers over {:.1f}s: {:.2f}% process cpu per peer, {:.1f} "
+           "datagrams/s sent, {:.1f} datagrams/s received",
+           bots.size(), elapsed, 100.0 * cpu_seconds / elapsed / bots.size(),
+           total_sent / elapsed, total_received / elapsed);
+  LOG_INFO("tick duration (us): p50 {:.0f}, p90 {:.0f}, p99 {:.0f}, p99.9 "
+           "{:.0f}, max {:.0f}; {} of {} ticks overran {} ms",
+           tick_durations.get_us(50), tick_durations.get_us(90),
+           tick_durations.get_us(99), tick_durations.get_us(99.9),
+           tick_durations.get_us(100), overruns, ticks, period.count());
+  LOG_INFO("tick lateness (us): p50 {:.0f}, p90 {:.0f}, p99 {:.0f}, max {:.0f}",
+           tick_lateness.get_us(50), tick_lateness.get_us(90),
+           tick_lateness.get_us(99), tick_lateness.get_us(100));
+
+  playout::Stats playout_stats;
+  for (const auto &bot : bots) {
+    auto decoders = bot.state->decoders.read();
+    for (const auto &[peer_id, decoder] : *decoders) {
+      playout_stats += decoder->playout->get_stats();
+    }
+  }
+  log_playout_stats("playout across all peers", playout_stats);
+
+  std::vector<profiler::EffectStats> effect_stats;
+  for (const auto &bot : bots) {
+    auto encoder = bot.state->encoder.read();
+    if (!*encoder || !(*encoder)->profiler) {
+      continue;
+    }
+    auto stats = (*encoder)->profiler->get_effect_stats();
+    if (effect_stats.empty()) {
+      effect_stats = std::move(stats);
+    } else {
+      for (std::size_t i = 0; i < std::min(stats.size(), effect_stats.size());
+           ++i) {
+        effect_stats[i] += stats[i];
+      }
+    }
+  }
+  if (!effect_stats.empty()) {
+    LOG_INFO("capture pipeline effects across all peers:");
+    log_effect_stats(effect_stats, capture_format);
+  }
+
+  LOG_INFO("leaving rooms and closing connections to server");
+  for (auto &bot : bots) {
+    if (local_room) {
+      local_room->leave(bot.state->loopback_peer_id);
+    } else {
+      odin_room_close(bot.state->room.get());
+    }
+  }
+}
+
 /**
  * The entry point of the program.
  */
 int main(int argc, char *argv[]) {
   State state;
+  enumerate_audio_devices();
 
   /**
    * Parse command-line options into globally available arguments.
@@ -745,29 +2471,6 @@ int main(int argc, char *argv[]) {
   LOG_INFO("initializing ODIN Voice runtime {}", ODIN_VERSION);
   CHECK(odin_initialize(ODIN_VERSION));
 
-  /**
-   * Create an optional ODIN cipher for end-to-end-encryption and configure it
-   * if a master password was specified via command-line.
-   */
-  OdinCipher *cipher = odin_crypto_create(ODIN_CRYPTO_VERSION);
-  if (has_argument("password")) {
-    auto password = get_argument<std::string>("password");
-    LOG_INFO("configuring ODIN cipher with password '{}'", password);
-    odin_crypto_set_password(cipher,
-                             reinterpret_cast<const uint8_t *>(password.data()),
-                             password.length());
-  }
-
-  /**
-   * Start playback/capture audio devices.
-   */
-  state.start_audio_devices(get_argument<int>("output-device"),
-                            get_argument<int>("output-sample-rate"),
-                            get_argument<int>("output-channels"),
-                            get_argument<int>("input-device"),
-                            get_argument<int>("input-sample-rate"),
-                            get_argument<int>("input-channels"));
-
   /**
    * Grab command-line arguments.
    */
@@ -794,9 +2497,10 @@ int main(int argc, char *argv[]) {
    * Production code should NEVER EVER generate tokens for authentication or
    * ship your access key on the client side!
    */
-  std::string room_token;
+  OpaquePtr<OdinTokenGenerator> token_generator(nullptr,
+                                                &odin_token_generator_free);
+  std::string access_key;
   if (!has_argument("room-token")) {
-    std::string access_key;
     if (!has_argument("access-key")) {
       if (auto e = read_access_key_file(ODIN_ACCESS_KEY_FILE, access_key); e) {
         LOG_WARNING("failed to read existing access key from '{}'; {}",
@@ -806,69 +2510,157 @@ int main(int argc, char *argv[]) {
       access_key = get_argument<std::string>("access-key");
     }
 
-    auto token_generator = get_token_generator(access_key);
+    token_generator = get_token_generator(access_key);
     if (auto e = write_access_key_file(ODIN_ACCESS_KEY_FILE, access_key); e) {
       LOG_WARNING("failed to write access key to '{}'; {}",
                   ODIN_ACCESS_KEY_FILE, e.message());
     }
     LOG_DEBUG("using access key: {}", access_key);
+  }
+  auto get_room_token = [&](const std::string &user_id) {
+    return token_generator ? generate_token(token_generator, room_id, user_id)
+                           : get_argument<std::string>("room-token");
+  };
 
-    room_token = generate_token(token_generator, room_id, user_id);
-    token_generator.reset();
-  } else {
-    room_token = get_argument<std::string>("room-token");
+  /**
+   * Run simulated peers instead of the interactive client if requested.
+   */
+  if (has_argument("headless")) {
+    run_headless(gateway, room_id, user_id,
+                 [&](const std::vector<std::string> &user_ids) {
+                   return token_generator
+                              ? generate_tokens(access_key, room_id, user_ids)
+                              : std::vector<std::string>(
+                                    user_ids.size(),
+                                    get_argument<std::string>("room-token"));
+                 });
+    odin_shutdown();
+    return EXIT_SUCCESS;
   }
-  LOG_DEBUG("using room token: {}", room_token);
 
   /**
-   * Build custom authentication string.
+   * Create an optional ODIN cipher for end-to-end-encryption in the
+   * background.
    */
-  nlohmann::json authentication = nlohmann::json::object({
-      // mandatory room token
-      {"token", room_token},
-      // optional room id in caase the token contains multiple room ids
-      {"room_id", room_id},
-      // optional list of channel masks
-      {"channel_masks",
-       {
-           // only want to hear peer 1 on channels 1, 3 and 5 (000...00010101)
-           {1, 0x15},
-       }},
-      // optional peer user data
-      {"user_data", {{"foo", "bar"}, {"time", std::time(0)}}},
-  });
+  auto cipher = create_cipher_async();
+
+  /**
+   * Start playback/capture audio devices.
+   */
+  state.mixer.limiter_threshold = get_argument<float>("limiter-threshold");
+  configure_encoder_settings(state);
+  configure_proximity(state);
+  configure_speaker_selection(state);
+  state.stats_interval =
+      std::chrono::seconds(get_argument<int>("stats-interval"));
+  if (has_argument("async-encoder")) {
+    LOG_INFO("encoding captured audio on a worker thread");
+    state.start_encoder_worker();
+  }
+  if (get_argument<int>("decode-threads") > 0) {
+    LOG_INFO("decoding peers on {} worker threads",
+             get_argument<int>("decode-threads"));
+    // 10 ms periods of the requested playback format, which the playback
+    // device is opened with
+    state.start_decoder_group(
+        get_argument<int>("decode-threads"),
+        get_argument<int>("output-sample-rate") / 100 *
+            std::clamp(get_argument<int>("output-channels"), 1, 2));
+  }
+  state.start_audio_devices(get_argument<int>("output-device"),
+                            get_argument<int>("output-sample-rate"),
+                            get_argument<int>("output-channels"),
+                            get_argument<int>("input-device"),
+                            get_argument<int>("input-sample-rate"),
+                            get_argument<int>("input-channels"));
+
+  auto room_token = get_room_token(user_id);
+  token_generator.reset();
+  LOG_DEBUG("using room token: {}", room_token);
 
   /*
-   * Create a new ODIN room pointer and establish an encrypted connection to
-   * the ODIN network using the given cipher and join the specified room.
+   * Join the specified room.
    */
-  OdinRoom *room;
-  OdinRoomEvents events{
-      .on_datagram = &on_datagram,
-      .on_rpc = &on_rpc,
-      .user_data = reinterpret_cast<void *>(&state),
-  };
-  CHECK(odin_room_create(gateway.data(), authentication.dump().data(), &events,
-                         cipher, &room));
-  state.room = {room, odin_room_free};
-  state.cipher = cipher;
+  create_room(state, gateway, build_authentication(room_token, room_id),
+              cipher.get());
 
   /**
-   * Wait for user input.
+   * Wait for user input on a separate thread while dispatching queued room
+   * events on this one.
    */
-  std::cout << "--- Press RETURN to leave room and exit ---" << std::endl;
-  getchar();
+  std::cout << "--- Press RETURN to leave room and exit or type 'help' to "
+               "change audio processing ---"
+            << std::endl;
+  std::atomic<bool> running = true;
+  std::thread input_thread([&running, &state] {
+    PipelineConfig config{global::apm_effect_config,
+                          global::vad_effect_config};
+    std::string line;
+    while (std::getline(std::cin, line) && !line.empty()) {
+      if (parse_receive_command(line, state.datagram_filter)) {
+        continue;
+      }
+      if (parse_pipeline_command(line, config)) {
+        state.pipeline_config.publish(config);
+      }
+    }
+    running = false;
+  });
+  std::vector<Rpc *> rpcs(ODIN_RPC_QUEUE_CAPACITY);
+  auto effect_stats_logged = std::chrono::steady_clock::now();
+  while (running && !state.left) {
+    auto count = state.poll_rpcs(rpcs.data(), rpcs.size());
+    for (std::size_t i = 0; i < count; ++i) {
+      handle_rpc(&state, rpcs[i]->json);
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now - effect_stats_logged >= std::chrono::seconds(10)) {
+      auto encoder = state.encoder.read();
+      if (*encoder && (*encoder)->profiler) {
+        log_effect_stats((*encoder)->profiler->get_effect_stats(),
+                         state.capture_format);
+        (*encoder)->profiler->reset();
+      }
+      effect_stats_logged = now;
+    }
+    state.adapt_encoder(now);
+    state.update_stats(now);
+    state.cull_peers(now);
+    state.decoders.collect();
+    if (count < rpcs.size()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  }
+  if (state.left) {
+    input_thread.detach();
+  } else {
+    input_thread.join();
+  }
+  LOG_DEBUG("dropped {} datagrams due to a full queue; {} rpcs spilled over",
+            state.datagrams.overflow_count(), state.rpcs_spilled.load());
+  LOG_DEBUG("filtered {} datagrams on arrival",
+            state.datagram_filter.dropped_count());
+  LOG_DEBUG("published {} audio processing changes; capture thread applied "
+            "{} and deferred {} while a change was being published",
+            state.pipeline_config.published_count(),
+            state.pipeline_config.taken_count(),
+            state.pipeline_config.deferred_count());
 
   /**
    * Stop playback/capture audio devices.
    */
   state.stop_audio_devices();
+  state.stop_encoder_worker();
+  if (state.capture_blocks) {
+    LOG_DEBUG("dropped {} capture blocks due to a full queue",
+              state.capture_blocks->overflow_count());
+  }
 
   /**
    * Disconnect from the room.
    */
   LOG_INFO("leaving room and closing connection to server");
-  odin_room_close(room);
+  odin_room_close(state.room.get());
 
   /*`
    * Shutdown the ODIN Voice runtime.
@@ -0,0 +1,380 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||            \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIXER_SIMD_SSE
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define MIXER_SIMD_AVX2_DISPATCH
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define MIXER_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#include <odin.h>
+
+namespace mixer {
+
+// ─── SAMPLE KERNELS ──────────────────────────────────────────────────────────
+
+namespace detail {
+
+#ifdef MIXER_SIMD_AVX2_DISPATCH
+__attribute__((target("avx2"))) inline std::size_t
+accumulate_avx2(float *dst, const float *src, float gain, std::size_t count) {
+  const __m256 g = _mm256_set1_ps(gain);
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 s = _mm256_mul_ps(_mm256_loadu_ps(src + i), g);
+    _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), s));
+  }
+  return i;
+}
+
+inline bool has_avx2() {
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+#endif
+
+struct Ignore {
+  template <typename... Args> void operator()(Args &&...) const {}
+};
+
+template <typename T> const T &deref(const T &value) { return value; }
+template <typename T> const T &deref(const std::shared_ptr<T> &value) {
+  return *value;
+}
+
+struct Pop {
+  template <typename Value>
+  const float *operator()(const Value &value, float *target,
+                          uint32_t samples_count, bool &is_silent) const {
+    if (odin_decoder_pop(deref(value).ptr.get(), target, samples_count,
+                         &is_silent) != ODIN_ERROR_SUCCESS) {
+      is_silent = true;
+    }
+    return target;
+  }
+};
+
+} // namespace detail
+
+/**
+ * Adds `count` samples from `src` scaled by `gain` to `dst`. Uses AVX2 when
+ * the CPU supports it, SSE or NEON otherwise and finishes with a scalar tail.
+ */
+inline void accumulate(float *dst, const float *src, float gain,
+                       std::size_t count) {
+  std::size_t i = 0;
+#if defined(MIXER_SIMD_AVX2_DISPATCH)
+  if (detail::has_avx2()) {
+    i = detail::accumulate_avx2(dst, src, gain, count);
+  }
+#endif
+#if defined(MIXER_SIMD_SSE)
+  const __m128 g = _mm_set1_ps(gain);
+  for (; i + 4 <= count; i += 4) {
+    __m128 s = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+    _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), s));
+  }
+#elif defined(MIXER_SIMD_NEON)
+  const float32x4_t g = vdupq_n_f32(gain);
+  for (; i + 4 <= count; i += 4) {
+    vst1q_f32(dst + i, vmlaq_f32(vld1q_f32(dst + i), vld1q_f32(src + i), g));
+  }
+#endif
+  for (; i < count; ++i) {
+    dst[i] += src[i] * gain;
+  }
+}
+
+/**
+ * Multiplies `count` samples in `samples` by `gain` in place.
+ */
+inline void scale(float *samples, float gain, std::size_t count) {
+  std::size_t i = 0;
+#if defined(MIXER_SIMD_SSE)
+  const __m128 g = _mm_set1_ps(gain);
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), g));
+  }
+#elif defined(MIXER_SIMD_NEON)
+  const float32x4_t g = vdupq_n_f32(gain);
+  for (; i + 4 <= count; i += 4) {
+    vst1q_f32(samples + i, vmulq_f32(vld1q_f32(samples + i), g));
+  }
+#endif
+  for (; i < count; ++i) {
+    samples[i] *= gain;
+  }
+}
+
+/**
+ * Returns the largest absolute sample value in the given buffer.
+ */
+inline float peak(const float *samples, std::size_t count) {
+  std::size_t i = 0;
+  float result = 0.0f;
+#if defined(MIXER_SIMD_SSE)
+  const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 m = _mm_setzero_ps();
+  for (; i + 4 <= count; i += 4) {
+    m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(samples + i), mask));
+  }
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, m);
+  result = std::max({lanes[0], lanes[1], lanes[2], lanes[3]});
+#elif defined(MIXER_SIMD_NEON)
+  float32x4_t m = vdupq_n_f32(0.0f);
+  for (; i + 4 <= count; i += 4) {
+    m = vmaxq_f32(m, vabsq_f32(vld1q_f32(samples + i)));
+  }
+  float lanes[4];
+  vst1q_f32(lanes, m);
+  result = std::max({lanes[0], lanes[1], lanes[2], lanes[3]});
+#endif
+  for (; i < count; ++i) {
+    result = std::max(result, std::fabs(samples[i]));
+  }
+  return result;
+}
+
+/**
+ * Applies a soft-knee limiter to the given buffer. Samples below `threshold`
+ * pass unchanged, everything above is compressed smoothly towards 1.0 instead
+ * of hard clipping. The buffer is only touched when its peak exceeds the
+ * threshold, which keeps the common case at a single vectorized scan. The
+ * threshold must be greater than 0; 1.0 disables the limiter.
+ */
+inline void soft_limit(float *samples, std::size_t count, float threshold) {
+  if (threshold >= 1.0f || peak(samples, count) <= threshold) {
+    return;
+  }
+  const float knee = 1.0f - threshold;
+  for (std::size_t i = 0; i < count; ++i) {
+    float magnitude = std::fabs(samples[i]);
+    if (magnitude > threshold) {
+      magnitude = threshold + knee * std::tanh((magnitude - threshold) / knee);
+      samples[i] = std::copysign(magnitude, samples[i]);
+    }
+  }
+}
+
+// ─── SAMPLE FORMATS ──────────────────────────────────────────────────────────
+
+/**
+ * Converts `count` signed 16-bit samples to floats in [-1, 1).
+ */
+inline void from_i16(const int16_t *src, float *dst, std::size_t count) {
+  std::size_t i = 0;
+#if defined(MIXER_SIMD_SSE)
+  const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+  for (; i + 8 <= count; i += 8) {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+#elif defined(MIXER_SIMD_NEON)
+  for (; i + 8 <= count; i += 8) {
+    int16x8_t s = vld1q_s16(src + i);
+    float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(s)));
+    float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(s)));
+    vst1q_f32(dst + i, vmulq_n_f32(lo, 1.0f / 32768.0f));
+    vst1q_f32(dst + i + 4, vmulq_n_f32(hi, 1.0f / 32768.0f));
+  }
+#endif
+  for (; i < count; ++i) {
+    dst[i] = src[i] * (1.0f / 32768.0f);
+  }
+}
+
+/**
+ * Converts `count` float samples to signed 16-bit, rounding to nearest and
+ * saturating everything outside of [-1, 1).
+ */
+inline void to_i16(const float *src, int16_t *dst, std::size_t count) {
+  std::size_t i = 0;
+#if defined(MIXER_SIMD_SSE)
+  const __m128 scale = _mm_set1_ps(32768.0f);
+  const __m128 lower = _mm_set1_ps(-32768.0f);
+  const __m128 upper = _mm_set1_ps(32767.0f);
+  for (; i + 8 <= count; i += 8) {
+    __m128 lo = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+    __m128 hi = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+    lo = _mm_min_ps(_mm_max_ps(lo, lower), upper);
+    hi = _mm_min_ps(_mm_max_ps(hi, lower), upper);
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(dst + i),
+        _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+  }
+#elif defined(MIXER_SIMD_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+  for (; i + 8 <= count; i += 8) {
+    int32x4_t lo = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i), 32768.0f));
+    int32x4_t hi =
+        vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i + 4), 32768.0f));
+    vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+  }
+#endif
+  for (; i < count; ++i) {
+    dst[i] = static_cast<int16_t>(
+        std::lrint(std::clamp(src[i] * 32768.0f, -32768.0f, 32767.0f)));
+  }
+}
+
+/**
+ * Interleaves `frames_count` frames from one buffer per channel into `dst`.
+ * Mono is a plain copy and stereo is vectorized.
+ */
+inline void interleave(const float *const *planes, std::size_t channels,
+                       float *dst, std::size_t frames_count) {
+  if (channels == 1) {
+    std::copy_n(planes[0], frames_count, dst);
+    return;
+  }
+  std::size_t frame = 0;
+  if (channels == 2) {
+    const float *left = planes[0], *right = planes[1];
+#if defined(MIXER_SIMD_SSE)
+    for (; frame + 4 <= frames_count; frame += 4) {
+      __m128 l = _mm_loadu_ps(left + frame), r = _mm_loadu_ps(right + frame);
+      _mm_storeu_ps(dst + frame * 2, _mm_unpacklo_ps(l, r));
+      _mm_storeu_ps(dst + frame * 2 + 4, _mm_unpackhi_ps(l, r));
+    }
+#elif defined(MIXER_SIMD_NEON)
+    for (; frame + 4 <= frames_count; frame += 4) {
+      float32x4x2_t s = {vld1q_f32(left + frame), vld1q_f32(right + frame)};
+      vst2q_f32(dst + frame * 2, s);
+    }
+#endif
+  }
+  for (; frame < frames_count; ++frame) {
+    for (std::size_t channel = 0; channel < channels; ++channel) {
+      dst[frame * channels + channel] = planes[channel][frame];
+    }
+  }
+}
+
+/**
+ * Splits `frames_count` interleaved frames from `src` into one buffer per
+ * channel. Mono is a plain copy and stereo is vectorized.
+ */
+inline void deinterleave(const float *src, float *const *planes,
+                         std::size_t channels, std::size_t frames_count) {
+  if (channels == 1) {
+    std::copy_n(src, frames_count, planes[0]);
+    return;
+  }
+  std::size_t frame = 0;
+  if (channels == 2) {
+    float *left = planes[0], *right = planes[1];
+#if defined(MIXER_SIMD_SSE)
+    for (; frame + 4 <= frames_count; frame += 4) {
+      __m128 a = _mm_loadu_ps(src + frame * 2);
+      __m128 b = _mm_loadu_ps(src + frame * 2 + 4);
+      _mm_storeu_ps(left + frame,
+                    _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps(right + frame,
+                    _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+#elif defined(MIXER_SIMD_NEON)
+    for (; frame + 4 <= frames_count; frame += 4) {
+      float32x4x2_t s = vld2q_f32(src + frame * 2);
+      vst1q_f32(left + frame, s.val[0]);
+      vst1q_f32(right + frame, s.val[1]);
+    }
+#endif
+  }
+  for (; frame < frames_count; ++frame) {
+    for (std::size_t channel = 0; channel < channels; ++channel) {
+      planes[channel][frame] = src[frame * channels + channel];
+    }
+  }
+}
+
+// ─── MIXER ───────────────────────────────────────────────────────────────────
+
+/**
+ * Mixes the output of multiple ODIN decoders into a single interleaved buffer.
+ * The first audible decoder is popped straight into the output buffer, all
+ * following ones go through a scratch buffer which is only reallocated when
+ * the requested block size grows. Silent or muted decoders are still popped
+ * to keep their buffers flowing, but skipped during accumulation.
+ */
+class Mixer {
+public:
+  /**
+   * Peak level above which the soft limiter starts compressing the mix. Use
+   * a value of `1.0` or higher to disable the limiter.
+   */
+  float limiter_threshold = 0.9f;
+
+  explicit Mixer(std::size_t max_samples_count = 0)
+      : scratch(max_samples_count) {}
+
+  /**
+   * Pops `samples_count` samples from every decoder in the given range and
+   * writes the mix into `out_samples`. The range is expected to yield
+   * key/value pairs whose value (directly or through a `std::shared_ptr`)
+   * provides a `ptr` to the `OdinDecoder` and a linear `gain`. If given,
+   * `on_pop` is called with each value and whether its block was silent.
+   * A custom `pop` can supply blocks that were decoded elsewhere; it is
+   * called with each value, a buffer it may fill and the silence flag, and
+   * returns the samples to mix. Returns the number of decoders that
+   * contributed audio.
+   */
+  template <typename Decoders, typename OnPop = detail::Ignore,
+            typename Pop = detail::Pop>
+  std::size_t mix(const Decoders &decoders, float *out_samples,
+                  uint32_t samples_count, OnPop &&on_pop = {},
+                  Pop &&pop = {}) {
+    if (this->scratch.size() < samples_count) {
+      this->scratch.resize(samples_count);
+    }
+
+    std::size_t mixed = 0;
+    for (const auto &[key, value] : decoders) {
+      const auto &decoder = detail::deref(value);
+      float *target = mixed ? this->scratch.data() : out_samples;
+      bool is_silent = true;
+      const float *source = pop(value, target, samples_count, is_silent);
+      on_pop(value, is_silent);
+      if (is_silent || decoder.gain <= 0.0f) {
+        continue;
+      }
+      if (mixed) {
+        accumulate(out_samples, source, decoder.gain, samples_count);
+      } else {
+        if (source != out_samples) {
+          std::copy_n(source, samples_count, out_samples);
+        }
+        if (decoder.gain != 1.0f) {
+          scale(out_samples, decoder.gain, samples_count);
+        }
+      }
+      ++mixed;
+    }
+
+    if (mixed) {
+      soft_limit(out_samples, samples_count, this->limiter_threshold);
+    } else {
+      std::fill_n(out_samples, samples_count, 0.0f);
+    }
+    return mixed;
+  }
+
+private:
+  std::vector<float> scratch;
+};
+
+} // namespace mixer
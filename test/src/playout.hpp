@@ -0,0 +1,337 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace playout {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Duration of the audio carried by a single voice datagram, assumed for a
+ * peer until enough datagrams have arrived to tell its actual packet rate.
+ */
+inline constexpr auto frame_duration = std::chrono::milliseconds(20);
+
+/**
+ * Datagram durations a peer may send with, depending on the frame duration
+ * and the number of frames per datagram its encoder was configured for.
+ */
+inline constexpr std::array<std::chrono::milliseconds, 4> frame_durations = {
+    std::chrono::milliseconds(10), std::chrono::milliseconds(20),
+    std::chrono::milliseconds(40), std::chrono::milliseconds(60)};
+
+/**
+ * Silence after which the next datagram from a peer starts a new talk spurt.
+ * Peers sending long datagrams need to miss at least two in a row instead.
+ */
+inline constexpr auto talk_spurt_gap = std::chrono::milliseconds(100);
+
+/**
+ * Bounds for the delay added at the start of every talk spurt. If the bounds
+ * differ, the delay adapts to the jitter observed for the peer; otherwise the
+ * initial delay is used throughout. All zero passes datagrams straight on.
+ */
+struct Config {
+  std::chrono::milliseconds initial_delay{0};
+  std::chrono::milliseconds min_delay{0};
+  std::chrono::milliseconds max_delay{0};
+};
+
+/**
+ * Point-in-time copy of the counters collected by a playout buffer.
+ */
+struct Stats {
+  uint64_t datagrams = 0;
+  uint64_t bytes = 0;
+  uint64_t talk_spurts = 0;
+  uint64_t gaps = 0;
+  uint64_t held = 0;
+  uint64_t overflows = 0;
+  uint64_t underruns = 0;
+  uint64_t lost = 0;
+  double frame_duration_ms = 0.0;
+  double jitter_ms = 0.0;
+  double target_delay_ms = 0.0;
+  Clock::time_point last_received{};
+
+  Stats &operator+=(const Stats &other) {
+    this->datagrams += other.datagrams;
+    this->bytes += other.bytes;
+    this->talk_spurts += other.talk_spurts;
+    this->gaps += other.gaps;
+    this->held += other.held;
+    this->overflows += other.overflows;
+    this->underruns += other.underruns;
+    this->lost += other.lost;
+    this->frame_duration_ms =
+        std::max(this->frame_duration_ms, other.frame_duration_ms);
+    this->jitter_ms = std::max(this->jitter_ms, other.jitter_ms);
+    this->target_delay_ms =
+        std::max(this->target_delay_ms, other.target_delay_ms);
+    this->last_received = std::max(this->last_received, other.last_received);
+    return *this;
+  }
+
+  /**
+   * Returns the estimated share of datagrams lost in transit in percent.
+   */
+  double loss_percent() const {
+    auto expected = this->datagrams + this->lost;
+    return expected ? 100.0 * this->lost / expected : 0.0;
+  }
+};
+
+/**
+ * Client-side playout buffer in front of an ODIN decoder. The decoder keeps
+ * its own jitter buffer, which cannot be tuned; this one trades latency for
+ * robustness by holding back the first datagrams of every talk spurt for a
+ * target delay before handing them on, which gives the decoder headroom for
+ * late packets without stretching audio in the middle of a sentence. The
+ * adaptive target follows four times the smoothed interarrival jitter (as
+ * defined in RFC 3550) within the configured bounds.
+ *
+ * The datagram duration of each peer is learned from the most common spacing
+ * of its datagrams, so jitter, gaps and losses are measured against the rate
+ * the peer actually sends at, whether that is one 10 ms frame per datagram
+ * or several longer ones.
+ *
+ * Datagrams carry no sequence numbers visible to the application, so losses
+ * are estimated per completed talk spurt by comparing the datagrams received
+ * with the number its duration implies, which is robust against jitter.
+ *
+ * All datagram handling happens on the audio thread and never allocates, as
+ * storage for the held datagrams is reserved up front. Counters are relaxed
+ * atomics which can be read from any thread.
+ */
+class Buffer {
+public:
+  Buffer(const Config &config, std::size_t max_datagram_size)
+      : config(config),
+        target_delay(config.max_delay > config.min_delay
+                         ? std::clamp(config.initial_delay, config.min_delay,
+                                      config.max_delay)
+                         : config.initial_delay),
+        slots(std::max(config.initial_delay, config.max_delay) /
+                  frame_durations.front() +
+              4) {
+    for (auto &slot : this->slots) {
+      slot.reserve(max_datagram_size);
+    }
+    this->target_delay_us.store(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            this->target_delay)
+            .count(),
+        std::memory_order_relaxed);
+    this->frame_us.store(std::chrono::microseconds(this->frame).count(),
+                         std::memory_order_relaxed);
+  }
+
+  Buffer(const Buffer &) = delete;
+  Buffer &operator=(const Buffer &) = delete;
+
+  /**
+   * Accepts a datagram received at `received` and either passes it to
+   * `deliver` right away or holds it until the talk spurt's release time.
+   */
+  template <typename F>
+  void push(Clock::time_point received, const uint8_t *bytes, uint32_t length,
+            F &&deliver) {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    this->datagrams.fetch_add(1, relaxed);
+    this->bytes.fetch_add(length, relaxed);
+    this->last_received_ns.store(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            received.time_since_epoch())
+            .count(),
+        relaxed);
+
+    bool starts_talk_spurt = true;
+    if (this->last_received.has_value()) {
+      auto interval = received - *this->last_received;
+      if (interval < std::max<Clock::duration>(talk_spurt_gap,
+                                               3 * this->frame)) {
+        starts_talk_spurt = false;
+        update_frame(interval);
+        update_jitter(interval);
+        if (interval > 2 * this->frame) {
+          this->gaps.fetch_add(1, relaxed);
+        }
+      }
+    }
+    if (starts_talk_spurt) {
+      this->finish_talk_spurt();
+      this->talk_spurt_started = received;
+      this->talk_spurt_datagrams = 0;
+    }
+    this->last_received = received;
+    ++this->talk_spurt_datagrams;
+
+    if (starts_talk_spurt) {
+      this->talk_spurts.fetch_add(1, relaxed);
+      this->flush_all(deliver);
+      this->adapt_target_delay();
+      this->release_at = received + this->target_delay;
+    }
+
+    if (received < this->release_at) {
+      if (this->held_count < this->slots.size()) {
+        this->slots[this->held_count++].assign(bytes, bytes + length);
+        this->held.fetch_add(1, relaxed);
+        return;
+      }
+      this->overflows.fetch_add(1, relaxed);
+      this->release_at = received;
+    }
+    this->flush_all(deliver);
+    deliver(bytes, length);
+  }
+
+  /**
+   * Passes all held datagrams on once their release time has come. Must be
+   * called once per audio period, even if nothing was received.
+   */
+  template <typename F> void flush(Clock::time_point now, F &&deliver) {
+    if (this->held_count && now >= this->release_at) {
+      this->flush_all(deliver);
+    }
+  }
+
+  /**
+   * Records the outcome of a decoder pop; a silent block while datagrams
+   * for the current talk spurt are still arriving counts as an underrun.
+   */
+  void record_pop(Clock::time_point now, bool is_silent) {
+    if (is_silent && this->held_count == 0 &&
+        this->last_received.has_value() &&
+        now - *this->last_received < 2 * this->frame) {
+      this->underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  Stats get_stats() const {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    Stats stats;
+    stats.datagrams = this->datagrams.load(relaxed);
+    stats.bytes = this->bytes.load(relaxed);
+    stats.talk_spurts = this->talk_spurts.load(relaxed);
+    stats.gaps = this->gaps.load(relaxed);
+    stats.held = this->held.load(relaxed);
+    stats.overflows = this->overflows.load(relaxed);
+    stats.underruns = this->underruns.load(relaxed);
+    stats.lost = this->lost.load(relaxed);
+    stats.frame_duration_ms = this->frame_us.load(relaxed) / 1000.0;
+    stats.jitter_ms = this->jitter_us.load(relaxed) / 1000.0;
+    stats.target_delay_ms = this->target_delay_us.load(relaxed) / 1000.0;
+    stats.last_received = Clock::time_point(
+        std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(
+            this->last_received_ns.load(relaxed))));
+    return stats;
+  }
+
+private:
+  void finish_talk_spurt() {
+    if (!this->last_received.has_value()) {
+      return;
+    }
+    auto expected = static_cast<uint64_t>(
+        (*this->last_received - this->talk_spurt_started + this->frame / 2) /
+            this->frame +
+        1);
+    if (expected > this->talk_spurt_datagrams) {
+      this->lost.fetch_add(expected - this->talk_spurt_datagrams,
+                           std::memory_order_relaxed);
+    }
+  }
+
+  void update_frame(Clock::duration interval) {
+    for (std::size_t i = 0; i < frame_durations.size(); ++i) {
+      auto duration = Clock::duration(frame_durations[i]);
+      if (interval > duration - duration / 4 &&
+          interval < duration + duration / 4) {
+        if (++this->frame_votes[i] == 64) {
+          for (auto &votes : this->frame_votes) {
+            votes /= 2;
+          }
+        }
+        break;
+      }
+    }
+    auto mode = std::max_element(this->frame_votes.begin(),
+                                 this->frame_votes.end()) -
+                this->frame_votes.begin();
+    if (this->frame_votes[mode] >= 8 &&
+        this->frame != frame_durations[mode]) {
+      this->frame = frame_durations[mode];
+      this->frame_us.store(std::chrono::microseconds(this->frame).count(),
+                           std::memory_order_relaxed);
+    }
+  }
+
+  void update_jitter(Clock::duration interval) {
+    auto deviation = std::chrono::duration<double, std::micro>(
+                         interval > this->frame ? interval - this->frame
+                                                : this->frame - interval)
+                         .count();
+    this->jitter += (deviation - this->jitter) / 16.0;
+    this->jitter_us.store(static_cast<int64_t>(this->jitter),
+                          std::memory_order_relaxed);
+  }
+
+  void adapt_target_delay() {
+    if (this->config.max_delay <= this->config.min_delay) {
+      return;
+    }
+    auto target = std::chrono::microseconds(
+        static_cast<int64_t>(4.0 * this->jitter));
+    this->target_delay = std::clamp<Clock::duration>(
+        target, this->config.min_delay, this->config.max_delay);
+    this->target_delay_us.store(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            this->target_delay)
+            .count(),
+        std::memory_order_relaxed);
+  }
+
+  template <typename F> void flush_all(F &&deliver) {
+    for (std::size_t i = 0; i < this->held_count; ++i) {
+      deliver(this->slots[i].data(),
+              static_cast<uint32_t>(this->slots[i].size()));
+    }
+    this->held_count = 0;
+  }
+
+  const Config config;
+  Clock::duration target_delay;
+  Clock::time_point release_at;
+  std::optional<Clock::time_point> last_received;
+  Clock::time_point talk_spurt_started;
+  uint64_t talk_spurt_datagrams = 0;
+  std::chrono::milliseconds frame = frame_duration;
+  std::array<uint32_t, frame_durations.size()> frame_votes{};
+  double jitter = 0.0;
+
+  std::vector<std::vector<uint8_t>> slots;
+  std::size_t held_count = 0;
+
+  std::atomic<uint64_t> datagrams{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> talk_spurts{0};
+  std::atomic<uint64_t> gaps{0};
+  std::atomic<uint64_t> held{0};
+  std::atomic<uint64_t> overflows{0};
+  std::atomic<uint64_t> underruns{0};
+  std::atomic<uint64_t> lost{0};
+  std::atomic<int64_t> frame_us{0};
+  std::atomic<int64_t> jitter_us{0};
+  std::atomic<int64_t> target_delay_us{0};
+  std::atomic<int64_t> last_received_ns{0};
+};
+
+} // namespace playout
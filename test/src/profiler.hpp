@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <odin.h>
+
+namespace profiler {
+
+/**
+ * Number of logarithmic histogram buckets. Bucket `i` counts invocations
+ * that took less than `2^i` ns, but at least `2^(i - 1)` ns; the last one
+ * collects everything above roughly one second.
+ */
+inline constexpr std::size_t histogram_buckets = 32;
+
+/**
+ * Point-in-time copy of the counters collected for a single effect.
+ */
+struct EffectStats {
+  uint32_t effect_id = 0;
+  OdinEffectType effect_type = ODIN_EFFECT_TYPE_CUSTOM;
+  uint64_t count = 0;
+  uint64_t total_ns = 0;
+  uint64_t max_ns = 0;
+  uint64_t samples = 0;
+  std::array<uint64_t, histogram_buckets> histogram{};
+
+  double mean_us() const {
+    return this->count ? this->total_ns / 1000.0 / this->count : 0.0;
+  }
+
+  /**
+   * Returns an upper bound for the given percentile (0-100) in microseconds,
+   * accurate to within a factor of two.
+   */
+  double percentile_us(double percentile) const {
+    const auto rank = static_cast<uint64_t>(
+        std::clamp(percentile / 100.0, 0.0, 1.0) * this->count);
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < histogram_buckets; ++i) {
+      seen += this->histogram[i];
+      if (seen >= rank && seen > 0) {
+        return std::min<double>(uint64_t{1} << i, this->max_ns) / 1000.0;
+      }
+    }
+    return this->max_ns / 1000.0;
+  }
+
+  EffectStats &operator+=(const EffectStats &other) {
+    this->count += other.count;
+    this->total_ns += other.total_ns;
+    this->max_ns = std::max(this->max_ns, other.max_ns);
+    this->samples += other.samples;
+    for (std::size_t i = 0; i < histogram_buckets; ++i) {
+      this->histogram[i] += other.histogram[i];
+    }
+    return *this;
+  }
+};
+
+inline const char *to_string(OdinEffectType effect_type) {
+  switch (effect_type) {
+  case ODIN_EFFECT_TYPE_VAD:
+    return "vad";
+  case ODIN_EFFECT_TYPE_APM:
+    return "apm";
+  default:
+    return "custom";
+  }
+}
+
+/**
+ * Measures the time spent in every effect of an ODIN audio pipeline. Custom
+ * probe effects are inserted before the first and after each existing effect,
+ * so the distance between two probes is the time taken by the effect they
+ * enclose. Counters are relaxed atomics updated on the audio thread and can
+ * be read or reset from any other thread without locking; a reset racing with
+ * an update may leave a single invocation partially counted.
+ *
+ * Effects added to the pipeline after the profiler was attached are counted
+ * towards the effect preceding them. The probes reference the profiler, so
+ * it must outlive the encoder or decoder owning the pipeline.
+ */
+class PipelineProfiler {
+public:
+  explicit PipelineProfiler(const OdinPipeline *pipeline)
+      : counters_count(odin_pipeline_get_effect_count(pipeline)),
+        counters(std::make_unique<Counters[]>(counters_count)),
+        probes(std::make_unique<Probe[]>(counters_count + 1)) {
+    for (uint32_t i = 0; i < this->counters_count; ++i) {
+      auto &counters = this->counters[i];
+      odin_pipeline_get_effect_id(pipeline, i, &counters.effect_id);
+      odin_pipeline_get_effect_type(pipeline, counters.effect_id,
+                                    &counters.effect_type);
+    }
+
+    // Insert back to front, so the original indices stay valid and the
+    // pipeline ends up as probe, effect, probe, effect, ..., probe.
+    for (auto i = this->counters_count + 1; i-- > 0;) {
+      this->probes[i] = Probe{this, i ? &this->counters[i - 1] : nullptr};
+      odin_pipeline_insert_custom_effect(pipeline, i, &on_probe,
+                                         &this->probes[i], nullptr);
+    }
+  }
+
+  PipelineProfiler(const PipelineProfiler &) = delete;
+  PipelineProfiler &operator=(const PipelineProfiler &) = delete;
+
+  /**
+   * Returns the stats of all profiled effects in pipeline order.
+   */
+  std::vector<EffectStats> get_effect_stats() const {
+    std::vector<EffectStats> result(this->counters_count);
+    for (std::size_t i = 0; i < this->counters_count; ++i) {
+      result[i] = this->counters[i].snapshot();
+    }
+    return result;
+  }
+
+  /**
+   * Returns the stats of the effect with the given id, if it is profiled.
+   */
+  std::optional<EffectStats> get_effect_stats(uint32_t effect_id) const {
+    for (std::size_t i = 0; i < this->counters_count; ++i) {
+      if (this->counters[i].effect_id == effect_id) {
+        return this->counters[i].snapshot();
+      }
+    }
+    return std::nullopt;
+  }
+
+  /**
+   * Clears the counters of all profiled effects.
+   */
+  void reset() {
+    for (std::size_t i = 0; i < this->counters_count; ++i) {
+      this->counters[i].reset();
+    }
+  }
+
+private:
+  struct Counters {
+    uint32_t effect_id = 0;
+    OdinEffectType effect_type = ODIN_EFFECT_TYPE_CUSTOM;
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+    std::atomic<uint64_t> samples{0};
+    std::array<std::atomic<uint64_t>, histogram_buckets> histogram{};
+
+    void record(uint64_t ns, uint32_t samples_count) {
+      constexpr auto relaxed = std::memory_order_relaxed;
+      this->count.fetch_add(1, relaxed);
+      this->total_ns.fetch_add(ns, relaxed);
+      this->samples.fetch_add(samples_count, relaxed);
+      auto max = this->max_ns.load(relaxed);
+      while (ns > max && !this->max_ns.compare_exchange_weak(max, ns, relaxed))
+        ;
+      auto bucket = std::min<std::size_t>(std::bit_width(ns),
+                                          histogram_buckets - 1);
+      this->histogram[bucket].fetch_add(1, relaxed);
+    }
+
+    EffectStats snapshot() const {
+      constexpr auto relaxed = std::memory_order_relaxed;
+      EffectStats stats;
+      stats.effect_id = this->effect_id;
+      stats.effect_type = this->effect_type;
+      stats.count = this->count.load(relaxed);
+      stats.total_ns = this->total_ns.load(relaxed);
+      stats.max_ns = this->max_ns.load(relaxed);
+      stats.samples = this->samples.load(relaxed);
+      for (std::size_t i = 0; i < histogram_buckets; ++i) {
+        stats.histogram[i] = this->histogram[i].load(relaxed);
+      }
+      return stats;
+    }
+
+    void reset() {
+      constexpr auto relaxed = std::memory_order_relaxed;
+      this->count.store(0, relaxed);
+      this->total_ns.store(0, relaxed);
+      this->max_ns.store(0, relaxed);
+      this->samples.store(0, relaxed);
+      for (auto &bucket : this->histogram) {
+        bucket.store(0, relaxed);
+      }
+    }
+  };
+
+  struct Probe {
+    PipelineProfiler *profiler;
+    Counters *counters;
+  };
+
+  static void on_probe(float *samples, uint32_t samples_count, bool *is_silent,
+                       const void *user_data) {
+    auto probe = static_cast<const Probe *>(user_data);
+    auto now = std::chrono::steady_clock::now();
+    if (probe->counters) {
+      auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          now - probe->profiler->last_probe);
+      probe->counters->record(static_cast<uint64_t>(elapsed.count()),
+                              samples_count);
+    }
+    probe->profiler->last_probe = now;
+  }
+
+  const uint32_t counters_count;
+  std::unique_ptr<Counters[]> counters;
+  std::unique_ptr<Probe[]> probes;
+  std::chrono::steady_clock::time_point last_probe;
+};
+
+} // namespace profiler
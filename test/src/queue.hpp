@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace queue {
+
+inline constexpr std::size_t cache_line_size = 64;
+
+/**
+ * Bounded, lock-free single-producer/single-consumer ring buffer. All slots
+ * are allocated up front and reused in place, so neither side allocates once
+ * the ring is constructed. The producer fills a slot in place through a
+ * callback, while the consumer acquires batches of slots and explicitly
+ * releases them once done, which allows zero-copy access to large payloads.
+ * Pushes into a full ring fail and are counted.
+ */
+template <typename T> class SpscRing {
+public:
+  explicit SpscRing(std::size_t capacity)
+      : mask(round_up_pow2(capacity) - 1),
+        slots(std::make_unique<T[]>(mask + 1)) {}
+
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  /**
+   * Claims the next free slot, passes it to `fill` and publishes it. Returns
+   * `false` without calling `fill` if the ring is full.
+   */
+  template <typename F> bool push(F &&fill) {
+    const auto head = this->head.load(std::memory_order_relaxed);
+    if (head - this->cached_tail > this->mask) {
+      this->cached_tail = this->tail.load(std::memory_order_acquire);
+      if (head - this->cached_tail > this->mask) {
+        this->overflows.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+    }
+    fill(this->slots[head & this->mask]);
+    this->head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Stores pointers to up to `max_count` published slots in `out_slots` in
+   * FIFO order and returns their count. The slots stay owned by the consumer
+   * and their contents remain valid until they are handed back via `release`.
+   */
+  std::size_t acquire(T **out_slots, std::size_t max_count) {
+    const auto tail = this->tail.load(std::memory_order_relaxed);
+    auto available = this->cached_head - tail;
+    if (available < max_count) {
+      this->cached_head = this->head.load(std::memory_order_acquire);
+      available = this->cached_head - tail;
+    }
+    const auto count = available < max_count ? available : max_count;
+    for (std::size_t i = 0; i < count; ++i) {
+      out_slots[i] = &this->slots[(tail + i) & this->mask];
+    }
+    return count;
+  }
+
+  /**
+   * Returns the oldest `count` slots obtained through `acquire` to the
+   * producer.
+   */
+  void release(std::size_t count) {
+    const auto tail = this->tail.load(std::memory_order_relaxed);
+    this->tail.store(tail + count, std::memory_order_release);
+  }
+
+  /**
+   * Returns the number of pushes rejected because the ring was full.
+   */
+  uint64_t overflow_count() const {
+    return this->overflows.load(std::memory_order_relaxed);
+  }
+
+  std::size_t capacity() const { return this->mask + 1; }
+
+private:
+  static std::size_t round_up_pow2(std::size_t value) {
+    std::size_t result = 1;
+    while (result < value) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  const std::size_t mask;
+  std::unique_ptr<T[]> slots;
+
+  alignas(cache_line_size) std::atomic<std::size_t> head{0};
+  std::size_t cached_tail = 0;
+  alignas(cache_line_size) std::atomic<std::size_t> tail{0};
+  std::size_t cached_head = 0;
+  alignas(cache_line_size) std::atomic<uint64_t> overflows{0};
+};
+
+} // namespace queue
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace rcu {
+
+/**
+ * Holds an immutable value which can be replaced by writers while readers
+ * keep accessing it without ever taking a lock. Writers publish a modified
+ * copy with a single atomic pointer swap and reclaim the previous value once
+ * all readers that might still observe it have left (a grace period tracked
+ * with two alternating reader counters). Readers never block, never allocate
+ * and never free; all of that is deferred to the writer.
+ */
+template <typename T> class Cell {
+public:
+  /**
+   * Scoped read access to the value that was current when the guard was
+   * created. The value is guaranteed to stay alive until the guard is gone.
+   */
+  class ReadGuard {
+  public:
+    ReadGuard(const ReadGuard &) = delete;
+    ReadGuard &operator=(const ReadGuard &) = delete;
+    ReadGuard(ReadGuard &&other) noexcept
+        : cell(std::exchange(other.cell, nullptr)), slot(other.slot),
+          value(other.value) {}
+    ~ReadGuard() {
+      if (this->cell) {
+        this->cell->readers[this->slot].fetch_sub(1,
+                                                  std::memory_order_release);
+      }
+    }
+
+    const T &operator*() const { return *this->value; }
+    const T *operator->() const { return this->value; }
+
+  private:
+    friend class Cell;
+    ReadGuard(const Cell *cell, uint32_t slot, const T *value)
+        : cell(cell), slot(slot), value(value) {}
+
+    const Cell *cell;
+    uint32_t slot;
+    const T *value;
+  };
+
+  explicit Cell(T initial = T{}) : current(new T(std::move(initial))) {}
+
+  Cell(const Cell &) = delete;
+  Cell &operator=(const Cell &) = delete;
+  ~Cell() { delete this->current.load(); }
+
+  /**
+   * Enters a read-side critical section. Wait-free for practical purposes;
+   * it only retries if a writer flips the epoch in between two loads.
+   */
+  ReadGuard read() const {
+    for (;;) {
+      auto epoch = this->epoch.load();
+      auto slot = static_cast<uint32_t>(epoch & 1);
+      this->readers[slot].fetch_add(1);
+      if (this->epoch.load() == epoch) {
+        return ReadGuard(this, slot, this->current.load());
+      }
+      this->readers[slot].fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  /**
+   * Copies the current value, applies `mutate` to the copy and publishes it.
+   * Writers are serialized and the call returns once the previous value has
+   * been reclaimed, so any resources it held are released on this thread.
+   */
+  template <typename F> void update(F &&mutate) {
+    std::lock_guard<std::mutex> lock(this->writer_mutex);
+    auto next = std::make_unique<T>(*this->current.load());
+    mutate(*next);
+    auto previous = this->current.exchange(next.release());
+    auto epoch = this->epoch.fetch_add(1);
+    while (this->readers[epoch & 1].load(std::memory_order_acquire) != 0) {
+      std::this_thread::yield();
+    }
+    delete previous;
+  }
+
+private:
+  std::atomic<T *> current;
+  std::atomic<uint64_t> epoch{0};
+  mutable std::atomic<uint32_t> readers[2] = {0, 0};
+  std::mutex writer_mutex;
+};
+
+} // namespace rcu
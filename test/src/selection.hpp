@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace selection {
+
+/**
+ * Tuning of the speaker selection. `margin` is the relative advantage a peer
+ * that is currently selected has over one that is not, and `smoothing` is the
+ * weight of the latest audio period in the level of each peer.
+ */
+struct Config {
+  std::size_t max_speakers = 0;
+  float margin = 0.5f;
+  float smoothing = 0.2f;
+};
+
+/**
+ * Activity of a single remote peer as seen by the selector. With VAD enabled
+ * on the sender and Opus in VBR mode, the number of bytes a peer sends per
+ * audio period grows with how loud and how busy its signal is and drops to
+ * zero while it is silent, which makes a usable level without decoding
+ * anything. The level is only touched on the audio thread, while the
+ * selection flag can be read anywhere.
+ */
+class Speaker {
+public:
+  void add_bytes(uint32_t bytes) { this->pending_bytes += bytes; }
+
+  bool is_selected() const {
+    return this->selected.load(std::memory_order_relaxed);
+  }
+
+private:
+  friend class Selector;
+
+  float level = 0.0f;
+  uint32_t pending_bytes = 0;
+  std::atomic<bool> selected{true};
+};
+
+/**
+ * Picks the loudest `max_speakers` peers once per audio period. Levels are
+ * smoothed over a few periods, and peers that are already selected have their
+ * level raised by the margin for the comparison, so a peer has to be clearly
+ * louder to take over a slot. Peers without a slot idle, their datagrams are
+ * neither decoded nor mixed. Scratch space grows with the number of peers and
+ * is kept across calls, so a stable room costs no allocations.
+ */
+class Selector {
+public:
+  explicit Selector(const Config &config, std::size_t expected_peers = 0)
+      : config(config) {
+    this->candidates.reserve(expected_peers);
+  }
+
+  /**
+   * Folds the bytes received since the last call into the level of the
+   * speaker `get` returns for every element of the given range and updates
+   * their selection. Elements for which `get` returns null do not compete.
+   */
+  template <typename Range, typename Get>
+  void update(const Range &range, Get &&get) {
+    auto &candidates = this->candidates;
+    candidates.clear();
+    for (const auto &element : range) {
+      Speaker *speaker = get(element);
+      if (!speaker) {
+        continue;
+      }
+      speaker->level += (speaker->pending_bytes - speaker->level) *
+                        this->config.smoothing;
+      speaker->pending_bytes = 0;
+      float score = speaker->level;
+      if (speaker->is_selected()) {
+        score *= 1.0f + this->config.margin;
+      }
+      candidates.push_back({score, speaker});
+    }
+
+    const auto slots = std::min(this->config.max_speakers, candidates.size());
+    std::nth_element(candidates.begin(), candidates.begin() + slots,
+                     candidates.end(), [](const auto &a, const auto &b) {
+                       return a.score > b.score;
+                     });
+    for (std::size_t i = 0; i < candidates.size(); ++i) {
+      candidates[i].speaker->selected.store(i < slots,
+                                            std::memory_order_relaxed);
+    }
+  }
+
+private:
+  struct Candidate {
+    float score;
+    Speaker *speaker;
+  };
+
+  const Config config;
+  std::vector<Candidate> candidates;
+};
+
+} // namespace selection
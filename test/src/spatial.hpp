@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+
+#include <odin.h>
+
+namespace spatial {
+
+inline float distance_squared(const OdinPosition &a, const OdinPosition &b) {
+  const float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+  return dx * dx + dy * dy + dz * dz;
+}
+
+/**
+ * Latest position reported by a remote peer and whether it is currently out
+ * of range. The audio thread stores positions as it pushes datagrams, while
+ * the culling decision is made elsewhere. Coordinates are separate relaxed
+ * atomics; a position torn between two updates is still good enough to tell
+ * near from far. Positions that are not finite are ignored, so a peer
+ * reporting garbage keeps its last known position.
+ */
+class PeerState {
+public:
+  void store_position(const OdinPosition &position) {
+    if (!std::isfinite(position.x) || !std::isfinite(position.y) ||
+        !std::isfinite(position.z)) {
+      return;
+    }
+    this->x.store(position.x, std::memory_order_relaxed);
+    this->y.store(position.y, std::memory_order_relaxed);
+    this->z.store(position.z, std::memory_order_relaxed);
+    this->known.store(true, std::memory_order_release);
+  }
+
+  std::optional<OdinPosition> load_position() const {
+    if (!this->known.load(std::memory_order_acquire)) {
+      return std::nullopt;
+    }
+    return OdinPosition{this->x.load(std::memory_order_relaxed),
+                        this->y.load(std::memory_order_relaxed),
+                        this->z.load(std::memory_order_relaxed)};
+  }
+
+  bool is_culled() const {
+    return this->culled.load(std::memory_order_relaxed);
+  }
+  void set_culled(bool culled) {
+    this->culled.store(culled, std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<float> x{0.0f};
+  std::atomic<float> y{0.0f};
+  std::atomic<float> z{0.0f};
+  std::atomic<bool> known{false};
+  std::atomic<bool> culled{false};
+};
+
+} // namespace spatial
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include <odin.h>
+
+#include "playout.hpp"
+
+namespace stats {
+
+/**
+ * Running minimum, mean and maximum of a series of samples.
+ */
+class Summary {
+public:
+  void record(double value) {
+    this->minimum = this->count ? std::min(this->minimum, value) : value;
+    this->maximum = this->count ? std::max(this->maximum, value) : value;
+    this->sum += value;
+    ++this->count;
+  }
+
+  void reset() { *this = Summary(); }
+
+  double min() const { return this->minimum; }
+  double mean() const { return this->count ? this->sum / this->count : 0.0; }
+  double max() const { return this->maximum; }
+  uint64_t samples() const { return this->count; }
+
+private:
+  double minimum = 0.0;
+  double maximum = 0.0;
+  double sum = 0.0;
+  uint64_t count = 0;
+};
+
+/**
+ * Connection statistics of a room. Extends the counters reported by ODIN with
+ * the round-trip time range observed since the last report, the payload bytes
+ * the client sent and received as datagrams and RPCs, and the loss and jitter
+ * measured on incoming audio.
+ */
+struct RoomStats {
+  OdinConnectionStats connection{};
+  double rtt_min_ms = 0.0;
+  double rtt_mean_ms = 0.0;
+  double rtt_max_ms = 0.0;
+  uint64_t datagram_tx_bytes = 0;
+  uint64_t datagram_rx_bytes = 0;
+  uint64_t rpc_tx_bytes = 0;
+  uint64_t rpc_rx_bytes = 0;
+  double loss_percent = 0.0;
+  double jitter_ms = 0.0;
+
+  /**
+   * Returns the UDP bytes sent beyond the payloads, which covers protocol
+   * headers, encryption, acknowledgements and retransmissions.
+   */
+  uint64_t overhead_tx_bytes() const {
+    auto payload = this->datagram_tx_bytes + this->rpc_tx_bytes;
+    return this->connection.udp_tx_bytes > payload
+               ? this->connection.udp_tx_bytes - payload
+               : 0;
+  }
+
+  /**
+   * Returns the UDP bytes received beyond the payloads.
+   */
+  uint64_t overhead_rx_bytes() const {
+    auto payload = this->datagram_rx_bytes + this->rpc_rx_bytes;
+    return this->connection.udp_rx_bytes > payload
+               ? this->connection.udp_rx_bytes - payload
+               : 0;
+  }
+};
+
+/**
+ * Receive statistics of a single remote peer.
+ */
+struct PeerStats {
+  uint32_t peer_id = 0;
+  playout::Stats playout;
+  std::optional<playout::Clock::duration> last_datagram_age;
+};
+
+/**
+ * Returns the rate in kbit/s at which a byte counter grew over `elapsed`.
+ */
+inline double kbps(uint64_t bytes, uint64_t previous_bytes,
+                   std::chrono::steady_clock::duration elapsed) {
+  auto seconds = std::chrono::duration<double>(elapsed).count();
+  return bytes > previous_bytes && seconds > 0.0
+             ? (bytes - previous_bytes) * 8 / 1000.0 / seconds
+             : 0.0;
+}
+
+} // namespace stats
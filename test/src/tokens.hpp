@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <odin.h>
+
+namespace tokens {
+
+/**
+ * Room token claims split into the part shared by every token of a room,
+ * serialized once up front, and the user ID and validity period filled in
+ * per token. Rendering into a reused string stops allocating once it has
+ * grown to the size of a token body.
+ */
+class ClaimsTemplate {
+public:
+  /**
+   * Creates a template from a JSON object with the static claims, e.g. the
+   * room ID and audience.
+   */
+  explicit ClaimsTemplate(const nlohmann::json &static_claims)
+      : prefix(static_claims.dump()) {
+    this->prefix.pop_back();
+    if (this->prefix.size() > 1) {
+      this->prefix.push_back(',');
+    }
+  }
+
+  /**
+   * Writes the token body for the given user and validity period to `out`.
+   */
+  void render(std::string &out, std::string_view user_id, int64_t nbf,
+              int64_t exp) const {
+    out.assign(this->prefix);
+    out.append("\"uid\":\"");
+    append_escaped(out, user_id);
+    out.append("\",\"nbf\":");
+    append_integer(out, nbf);
+    out.append(",\"exp\":");
+    append_integer(out, exp);
+    out.push_back('}');
+  }
+
+private:
+  static void append_escaped(std::string &out, std::string_view value) {
+    for (char c : value) {
+      switch (c) {
+      case '"':
+        out.append("\\\"");
+        break;
+      case '\\':
+        out.append("\\\\");
+        break;
+      case '\n':
+        out.append("\\n");
+        break;
+      case '\r':
+        out.append("\\r");
+        break;
+      case '\t':
+        out.append("\\t");
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char escaped[8];
+          std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          out.append(escaped);
+        } else {
+          out.push_back(c);
+        }
+      }
+    }
+  }
+
+  static void append_integer(std::string &out, int64_t value) {
+    char digits[24];
+    auto result = std::to_chars(std::begin(digits), std::end(digits), value);
+    out.append(digits, result.ptr);
+  }
+
+  std::string prefix;
+};
+
+/**
+ * Signs room tokens for many users at once, e.g. for a whole match or a
+ * batch of simulated peers. The batch is split evenly between one token
+ * generator per thread, all created from the same access key, so the
+ * threads never share a generator. The calling thread signs the first
+ * share itself.
+ */
+class BatchSigner {
+public:
+  /**
+   * Creates a signer with `threads_count` generators for the given access
+   * key. Returns `nullptr` if a generator cannot be created.
+   */
+  static std::unique_ptr<BatchSigner> create(const std::string &access_key,
+                                             std::size_t threads_count) {
+    auto signer = std::unique_ptr<BatchSigner>(new BatchSigner());
+    for (std::size_t i = 0; i < std::max<std::size_t>(threads_count, 1); ++i) {
+      OdinTokenGenerator *generator;
+      if (odin_token_generator_create(access_key.c_str(), &generator) !=
+          ODIN_ERROR_SUCCESS) {
+        return nullptr;
+      }
+      signer->generators.emplace_back(generator, &odin_token_generator_free);
+    }
+    return signer;
+  }
+
+  std::size_t threads() const { return this->generators.size(); }
+
+  /**
+   * Signs a token for every user ID with the given claims and validity
+   * period and stores them in `out_tokens` in the same order. Returns the
+   * first error encountered, if any.
+   */
+  OdinError sign(const ClaimsTemplate &claims,
+                 const std::vector<std::string> &user_ids, int64_t nbf,
+                 int64_t exp, std::vector<std::string> &out_tokens) {
+    out_tokens.resize(user_ids.size());
+    std::atomic<OdinError> error = ODIN_ERROR_SUCCESS;
+    auto sign_range = [&](OdinTokenGenerator *generator, std::size_t begin,
+                          std::size_t end) {
+      std::string body;
+      for (std::size_t i = begin; i < end; ++i) {
+        claims.render(body, user_ids[i], nbf, exp);
+        auto &token = out_tokens[i];
+        token.resize(token_capacity);
+        uint32_t token_length = token.size();
+        auto result = odin_token_generator_sign(generator, body.c_str(),
+                                                token.data(), &token_length);
+        if (result != ODIN_ERROR_SUCCESS) {
+          auto expected = ODIN_ERROR_SUCCESS;
+          error.compare_exchange_strong(expected, result);
+          return;
+        }
+        token.resize(token_length);
+      }
+    };
+
+    const auto threads_count =
+        std::min(this->generators.size(), std::max<std::size_t>(
+                                              user_ids.size(), 1));
+    const auto share = (user_ids.size() + threads_count - 1) / threads_count;
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < threads_count; ++i) {
+      auto begin = std::min(i * share, user_ids.size());
+      auto end = std::min(begin + share, user_ids.size());
+      workers.emplace_back(sign_range, this->generators[i].get(), begin, end);
+    }
+    sign_range(this->generators[0].get(), 0,
+               std::min(share, user_ids.size()));
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    return error.load();
+  }
+
+private:
+  static constexpr std::size_t token_capacity = 1024;
+
+  BatchSigner() = default;
+
+  std::vector<std::unique_ptr<OdinTokenGenerator,
+                              decltype(&odin_token_generator_free)>>
+      generators;
+};
+
+} // namespace tokens